@@ -1,61 +1,98 @@
 #include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
 
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <type_traits>
 
 #include <QtCore/QIODevice>
+#include <QtCore/QFileDevice>
 #include <QtCore/QByteArray>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
+#include <QtCore/QLocale>
 #include <QtCore/QVariant>
 #include <QtCore/QRect>
 #include <QtCore/QPoint>
 #include <QtCore/QLine>
 #include <QtCore/QDateTime>
+#include <QtCore/QUuid>
+#include <QtCore/QUrl>
 #include <QtCore/QVarLengthArray>
+#include <QtCore/QSet>
+#include <QtCore/QMutex>
 
-// Qt 6.8
+// Same encoding as QSettingsPrivate::variantToString and stringToVariant in Qt 6.8, without the
+// string APIs that are missing from Qt 5. Arguments of geometry values are parsed in place.
 namespace _QSettingsPrivate {
 
-    using namespace Qt::StringLiterals;
-
-    static QStringList splitArgs(const QString &s, qsizetype idx) {
-        qsizetype l = s.size();
-        Q_ASSERT(l > 0);
-        Q_ASSERT(s.at(idx) == u'(');
-        Q_ASSERT(s.at(l - 1) == u')');
+    // Same as QString::toInt for a token of a geometry value, 0 unless the whole token is a
+    // decimal integer in range
+    static int parseInt(QStringView s) {
+        qsizetype i = 0;
+        bool negative = false;
+        if (i < s.size() && (s[i] == QLatin1Char('-') || s[i] == QLatin1Char('+'))) {
+            negative = s[i] == QLatin1Char('-');
+            ++i;
+        }
+        if (i == s.size()) {
+            return 0;
+        }
 
-        QStringList result;
-        QString item;
-
-        for (++idx; idx < l; ++idx) {
-            QChar c = s.at(idx);
-            if (c == u')') {
-                Q_ASSERT(idx == l - 1);
-                result.append(item);
-            } else if (c == u' ') {
-                result.append(item);
-                item.clear();
-            } else {
-                item.append(c);
+        qint64 num = 0;
+        for (; i < s.size(); ++i) {
+            const char16_t c = s[i].unicode();
+            if (c < u'0' || c > u'9') {
+                return 0;
+            }
+            num = num * 10 + (c - u'0');
+            if (num > qint64(std::numeric_limits<int>::max()) + 1) {
+                return 0;
             }
         }
+        num = negative ? -num : num;
+        return num > std::numeric_limits<int>::max() ? 0 : int(num);
+    }
 
-        return result;
+    // Parses the space separated arguments between the parentheses at "idx" and the end of the
+    // string, returns the number of arguments
+    template <qsizetype N>
+    static qsizetype splitArgs(QStringView s, qsizetype idx, int (&args)[N]) {
+        Q_ASSERT(s.at(idx) == QLatin1Char('('));
+        Q_ASSERT(s.back() == QLatin1Char(')'));
+
+        const QStringView body = s.mid(idx + 1, s.size() - idx - 2);
+        qsizetype count = 0;
+        qsizetype start = 0;
+        for (qsizetype i = 0; i <= body.size(); ++i) {
+            if (i < body.size() && body[i] != QLatin1Char(' ')) {
+                continue;
+            }
+            if (count == N) {
+                return N + 1;
+            }
+            args[count++] = parseInt(body.mid(start, i - start));
+            start = i + 1;
+        }
+        return count;
     }
 
     static QString variantToString(const QVariant &v) {
         QString result;
 
-        switch (v.metaType().id()) {
+        switch (v.userType()) {
             case QMetaType::UnknownType:
-                result = "@Invalid()"_L1;
+                result = QLatin1String("@Invalid()");
                 break;
 
             case QMetaType::QByteArray: {
                 QByteArray a = v.toByteArray();
-                result = "@ByteArray("_L1 + QLatin1StringView(a) + u')';
+                result = QLatin1String("@ByteArray(") + QLatin1String(a.constData(), a.size()) +
+                         QLatin1Char(')');
                 break;
             }
 
@@ -72,9 +109,9 @@ namespace _QSettingsPrivate {
             case QMetaType::Double: {
                 result = v.toString();
                 if (result.contains(QChar::Null))
-                    result = "@String("_L1 + result + u')';
-                else if (result.startsWith(u'@'))
-                    result.prepend(u'@');
+                    result = QLatin1String("@String(") + result + QLatin1Char(')');
+                else if (result.startsWith(QLatin1Char('@')))
+                    result.prepend(QLatin1Char('@'));
                 break;
             }
 #ifndef QT_NO_GEOM_VARIANT
@@ -114,8 +151,8 @@ namespace _QSettingsPrivate {
                     s << v;
                 }
 
-                result =
-                    QLatin1StringView(typeSpec) + QLatin1StringView(a.constData(), a.size()) + u')';
+                result = QLatin1String(typeSpec) + QLatin1String(a.constData(), a.size()) +
+                         QLatin1Char(')');
 #else
                 Q_ASSERT(!"QSettings: Cannot save custom types without QDataStream support");
 #endif
@@ -127,24 +164,25 @@ namespace _QSettingsPrivate {
     }
 
     static QVariant stringToVariant(const QString &s) {
-        if (s.startsWith(u'@')) {
-            if (s.endsWith(u')')) {
-                if (s.startsWith("@ByteArray("_L1)) {
-                    return QVariant(QStringView{s}.sliced(11).chopped(1).toLatin1());
-                } else if (s.startsWith("@String("_L1)) {
-                    return QVariant(QStringView{s}.sliced(8).chopped(1).toString());
-                } else if (s.startsWith("@Variant("_L1) || s.startsWith("@DateTime("_L1)) {
+        if (s.startsWith(QLatin1Char('@'))) {
+            if (s.endsWith(QLatin1Char(')'))) {
+                if (s.startsWith(QLatin1String("@ByteArray("))) {
+                    return QVariant(QStringView(s).mid(11).chopped(1).toLatin1());
+                } else if (s.startsWith(QLatin1String("@String("))) {
+                    return QVariant(QStringView(s).mid(8).chopped(1).toString());
+                } else if (s.startsWith(QLatin1String("@Variant(")) ||
+                           s.startsWith(QLatin1String("@DateTime("))) {
 #ifndef QT_NO_DATASTREAM
                     QDataStream::Version version;
                     int offset;
-                    if (s.at(1) == u'D') {
+                    if (s.at(1) == QLatin1Char('D')) {
                         version = QDataStream::Qt_5_6;
                         offset = 10;
                     } else {
                         version = QDataStream::Qt_4_0;
                         offset = 9;
                     }
-                    QByteArray a = QStringView{s}.sliced(offset).toLatin1();
+                    QByteArray a = QStringView(s).mid(offset).toLatin1();
                     QDataStream stream(&a, QIODevice::ReadOnly);
                     stream.setVersion(version);
                     QVariant result;
@@ -154,26 +192,25 @@ namespace _QSettingsPrivate {
                     Q_ASSERT(!"QSettings: Cannot load custom types without QDataStream support");
 #endif
 #ifndef QT_NO_GEOM_VARIANT
-                } else if (s.startsWith("@Rect("_L1)) {
-                    QStringList args = splitArgs(s, 5);
-                    if (args.size() == 4)
-                        return QVariant(QRect(args[0].toInt(), args[1].toInt(), args[2].toInt(),
-                                              args[3].toInt()));
-                } else if (s.startsWith("@Size("_L1)) {
-                    QStringList args = splitArgs(s, 5);
-                    if (args.size() == 2)
-                        return QVariant(QSize(args[0].toInt(), args[1].toInt()));
-                } else if (s.startsWith("@Point("_L1)) {
-                    QStringList args = splitArgs(s, 6);
-                    if (args.size() == 2)
-                        return QVariant(QPoint(args[0].toInt(), args[1].toInt()));
+                } else if (s.startsWith(QLatin1String("@Rect("))) {
+                    int args[4];
+                    if (splitArgs(s, 5, args) == 4)
+                        return QVariant(QRect(args[0], args[1], args[2], args[3]));
+                } else if (s.startsWith(QLatin1String("@Size("))) {
+                    int args[2];
+                    if (splitArgs(s, 5, args) == 2)
+                        return QVariant(QSize(args[0], args[1]));
+                } else if (s.startsWith(QLatin1String("@Point("))) {
+                    int args[2];
+                    if (splitArgs(s, 6, args) == 2)
+                        return QVariant(QPoint(args[0], args[1]));
 #endif
-                } else if (s == "@Invalid()"_L1) {
+                } else if (s == QLatin1String("@Invalid()")) {
                     return QVariant();
                 }
             }
-            if (s.startsWith("@@"_L1))
-                return QVariant(s.sliced(1));
+            if (s.startsWith(QLatin1String("@@")))
+                return QVariant(s.mid(1));
         }
 
         return QVariant(s);
@@ -181,763 +218,2037 @@ namespace _QSettingsPrivate {
 
 }
 
+using namespace QJsonSettingsPrivate;
+
 // UTILS
 namespace {
 
-    static const QString kKeyValue = QStringLiteral("$value");
+    // Typed homogeneous arrays are tagged by type name, because the ids of non-builtin meta
+    // types are assigned at runtime and are not stable between runs
+    static const QString kTypeDoubleList = QStringLiteral("QList<double>");
 
-    static const QString kKeyValueType = QStringLiteral("$type");
+    static const QString kTypeIntList = QStringLiteral("QList<int>");
 
-    static const QString kKeyValueData = QStringLiteral("$data");
+    template <class T>
+    QList<T> jsonArrayToTypedList(const QJsonValue &value) {
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+        // Qt 5 compares variants of non-builtin types by address unless a comparator is registered
+        static const bool registered = QMetaType::registerEqualsComparator<QList<T>>();
+        Q_UNUSED(registered)
+#endif
+        QList<T> result;
+        if (value.isArray()) {
+            const auto &arr = value.toArray();
+            result.reserve(arr.size());
+            for (const auto &v : arr) {
+                if constexpr (std::is_integral_v<T>) {
+                    result.append(v.toInt());
+                } else {
+                    result.append(v.toDouble());
+                }
+            }
+        }
+        return result;
+    }
 
-    static const QLatin1Char kSeparator = QLatin1Char('/');
+    // The number as T if its integer part is in the range of T, converting it is undefined
+    // otherwise. The upper bound is 2^digits, the maximum itself isn't exact as a double.
+    template <class T>
+    QVariant integerOrDouble(double num) {
+        constexpr double limit = double(T(1) << (std::numeric_limits<T>::digits - 1)) * 2;
+        const double integral = std::trunc(num);
+        if (integral >= double(std::numeric_limits<T>::min()) && integral < limit) {
+            return QVariant::fromValue(T(num));
+        }
+        return num;
+    }
 
-    // READ
-    QVariant jsonValueToVariant(const QJsonValue &value) {
-        switch (value.type()) {
-            case QJsonValue::Bool:
-                return value.toBool();
-            case QJsonValue::Double:
-                return value.toDouble();
-            case QJsonValue::String:
-                return value.toString();
-            case QJsonValue::Array:
-                return value.toArray();
-            case QJsonValue::Object: {
-                const auto &obj = value.toObject();
-                auto it = obj.find(kKeyValueType);
-                if (it == obj.end()) {
-                    return obj;
-                }
-                int type = it.value().toInt();
+    template <class T>
+    QJsonArray typedListToJsonArray(const QList<T> &list) {
+        QJsonArray result;
+        for (const T &v : list) {
+            result.append(v);
+        }
+        return result;
+    }
 
-                it = obj.find(kKeyValueData);
-                if (it == obj.end()) {
-                    return obj;
-                }
-                const auto &value = it.value();
+    // Values written by the QDataStream fallback before native encodings were added
+    inline bool isLegacyEncoded(const QString &s) {
+        return s.startsWith(QLatin1String("@Variant(")) ||
+               s.startsWith(QLatin1String("@DateTime("));
+    }
 
-                switch (type) {
-                    // Large integer types
-                    case QMetaType::LongLong: {
-                        return value.toString().toLongLong();
-                    }
-                    case QMetaType::ULongLong: {
-                        return value.toString().toULongLong();
-                    }
+    // ISO 8601 strings only cover years 1 to 9999
+    inline bool isIsoDate(const QDate &date) {
+        return !date.isValid() || (date.year() >= 1 && date.year() <= 9999);
+    }
 
-                    // String list
-                    case QMetaType::QStringList: {
-                        QStringList result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            result.reserve(arr.size());
-                            for (const auto &v : arr) {
-                                result.append(v.toString());
-                            }
-                        }
-                        return result;
-                    }
+    // Global intern table, hands out shared copies of recurring key paths and short string
+    // values so that repeated reads don't keep identical strings alive separately
+    // Strings are kept in two generations. Once the current one is full it becomes the previous
+    // one and the strings that weren't looked up since are dropped, so the table holds at most
+    // twice the size of a generation. Strings that are still used by settings stay shared.
+    class StringPool {
+    public:
+        static constexpr qsizetype kGenerationSize = 8192;
+
+        // Locks for each lookup only, so that concurrent reads interleave instead of waiting for
+        // each other's whole conversion
+        QString intern(const QString &s) {
+            QMutexLocker locker(&mutex);
+            auto it = current.constFind(s);
+            if (it != current.constEnd()) {
+                return *it;
+            }
+            QString result = s;
+            it = previous.constFind(s);
+            if (it != previous.constEnd()) {
+                result = *it;
+            }
+            if (current.size() >= kGenerationSize) {
+                previous = std::move(current);
+                current = {};
+            }
+            current.insert(result);
+            return result;
+        }
 
-                    // Byte array
-                    case QMetaType::QByteArray: {
-                        QByteArray result;
-                        if (value.isString()) {
-                            result = value.toString().toLatin1();
-                        }
-                        return result;
-                    }
+        void clear() {
+            QMutexLocker locker(&mutex);
+            current = {};
+            previous = {};
+        }
 
-                    // Simple structure types
-                    case QMetaType::QRect: {
-                        QRect result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 4) {
-                                result = {
-                                    arr[0].toInt(),
-                                    arr[1].toInt(),
-                                    arr[2].toInt(),
-                                    arr[3].toInt(),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QRectF: {
-                        QRectF result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 4) {
-                                result = {
-                                    arr[0].toDouble(),
-                                    arr[1].toDouble(),
-                                    arr[2].toDouble(),
-                                    arr[3].toDouble(),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QSize: {
-                        QSize result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 2) {
-                                result = {
-                                    arr[0].toInt(),
-                                    arr[1].toInt(),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QSizeF: {
-                        QSizeF result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 2) {
-                                result = {
-                                    arr[0].toDouble(),
-                                    arr[1].toDouble(),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QPoint: {
-                        QPoint result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 2) {
-                                result = {
-                                    arr[0].toInt(),
-                                    arr[1].toInt(),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QPointF: {
-                        QPointF result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 2) {
-                                result = {
-                                    arr[0].toDouble(),
-                                    arr[1].toDouble(),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QLine: {
-                        QLine result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 4) {
-                                result = {
-                                    QPoint(arr[0].toInt(), arr[1].toInt()),
-                                    QPoint(arr[2].toInt(), arr[3].toInt()),
-                                };
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QLineF: {
-                        QLineF result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 4) {
-                                result = {
-                                    QPointF(arr[0].toDouble(), arr[1].toDouble()),
-                                    QPointF(arr[2].toDouble(), arr[3].toDouble()),
-                                };
-                            }
-                        }
-                        return result;
-                    }
+    private:
+        QMutex mutex;
+        QSet<QString> current;
+        QSet<QString> previous;
+    };
 
-                    // Variant container types
-                    case QMetaType::QVariantPair: {
-                        QVariantPair result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            if (arr.size() == 2) {
-                                result = {
-                                    jsonValueToVariant(arr[0]),
-                                    jsonValueToVariant(arr[1]),
-                                };
-                            }
-                        }
-                        return QVariant::fromValue(result);
-                    }
-                    case QMetaType::QVariantList: {
-                        QVariantList result;
-                        if (value.isArray()) {
-                            const auto &arr = value.toArray();
-                            result.reserve(arr.size());
-                            for (const auto &v : arr) {
-                                result.append(jsonValueToVariant(v));
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QVariantMap: {
-                        QVariantMap result;
-                        if (value.isObject()) {
-                            const auto &obj = value.toObject();
-                            for (auto it = obj.begin(); it != obj.end(); ++it) {
-                                result.insert(it.key(), jsonValueToVariant(it.value()));
-                            }
-                        }
-                        return result;
-                    }
-                    case QMetaType::QVariantHash: {
-                        QVariantHash result;
-                        if (value.isObject()) {
-                            const auto &obj = value.toObject();
-                            for (auto it = obj.begin(); it != obj.end(); ++it) {
-                                result.insert(it.key(), jsonValueToVariant(it.value()));
-                            }
-                        }
-                        return result;
-                    }
+    static StringPool &stringPool() {
+        static StringPool pool;
+        return pool;
+    }
 
-                    // Complex json types
-                    case QMetaType::QJsonValue: {
-                        return (QJsonValue) value;
-                    }
-                    case QMetaType::QJsonObject: {
-                        return value.toObject();
-                    }
-                    case QMetaType::QJsonDocument: {
-                        QJsonDocument doc;
-                        if (value.isObject()) {
-                            doc.setObject(value.toObject());
-                        } else if (value.isArray()) {
-                            doc.setArray(value.toArray());
-                        }
-                        return doc;
-                    }
+    static std::atomic<bool> stringInterningEnabled{false};
 
-                    // Unknown type
-                    case QMetaType::UnknownType: {
-                        return QVariant();
-                    }
-                    default:
-                        break;
+    // Only short values are likely to recur, long ones would just bloat the table
+    static constexpr qsizetype kMaxInternedValueLength = 32;
+
+    static std::atomic<bool> valueReferencesEnabled{false};
+
+    static std::atomic<bool> compactTagsEnabled{false};
+
+    // Keys of the tagged values being written
+    inline const QString &valueTypeKey() {
+        return compactTagsEnabled.load(std::memory_order_relaxed) ? kKeyCompactValueType
+                                                                  : kKeyValueType;
+    }
+
+    inline const QString &valueDataKey() {
+        return compactTagsEnabled.load(std::memory_order_relaxed) ? kKeyCompactValueData
+                                                                  : kKeyValueData;
+    }
+
+    static std::atomic<QJsonSettings::SizeEstimateHandler> sizeEstimateCallback{nullptr};
+
+    // Running averages of the documents read and written so far, used to size the buffers of
+    // the next ones
+    static std::atomic<qsizetype> averageLeafBytes{48};
+
+    static std::atomic<qsizetype> averageBranchLeafs{4};
+
+    // Moves a running average a quarter of the way to the sample, retried if another thread
+    // updated it in between so that no sample is lost
+    void updateAverage(std::atomic<qsizetype> &average, qsizetype sample) {
+        qsizetype value = average.load(std::memory_order_relaxed);
+        while (!average.compare_exchange_weak(value,
+                                              qMax<qsizetype>(1, value + (sample - value) / 4),
+                                              std::memory_order_relaxed)) {
+        }
+    }
+
+    void updateAverages(qsizetype bytes, qsizetype leafCount, qsizetype branchCount) {
+        if (leafCount > 0 && branchCount > 0) {
+            updateAverage(averageLeafBytes, bytes / leafCount);
+            updateAverage(averageBranchLeafs, leafCount / branchCount);
+        }
+    }
+
+    // Number of groups spanned by the keys of a sorted map, each key adds the groups it doesn't
+    // share with the previous key. Only overestimates if a sibling sorts between two keys of the
+    // same group, like "a-b" between "a/b" and "a/c".
+    qsizetype estimateGroupCount(const QVariantMap &settings) {
+        qsizetype count = 0;
+        QStringView prev;
+        for (auto it = settings.keyBegin(); it != settings.keyEnd(); ++it) {
+            const QStringView key = *it;
+            const qsizetype size = qMin(prev.size(), key.size());
+            qsizetype shared = -1;
+            for (qsizetype i = 0; i < size && prev[i] == key[i]; ++i) {
+                if (key[i] == kSeparator) {
+                    shared = i;
                 }
-                return _QSettingsPrivate::stringToVariant(value.toString());
             }
-            default:
-                break;
+            count += countSeparators(key.mid(shared + 1));
+            prev = key;
         }
-        return {};
+        return count;
     }
 
-    QJsonValue variantToJsonValue(const QVariant &value) {
-        switch (value.metaType().id()) {
-            // Primitive types
-            case QMetaType::Bool: {
+    // Whether arrays and objects nest deeper than the limit in the value. Decoding goes one level
+    // deeper for each tagged container, which takes two levels of nesting, so a value within the
+    // limit decodes without exceeding the depth limit.
+    bool exceedsNesting(const QJsonValue &value, int limit) {
+        // Containers still to be checked, with the levels left for them
+        QVarLengthArray<std::pair<QJsonValue, int>, 32> stack;
+        const auto push = [&stack](const QJsonValue &child, int levels) {
+            if (child.isArray() || child.isObject()) {
+                stack.append({child, levels});
+            }
+        };
+        push(value, limit);
+        while (!stack.isEmpty()) {
+            const auto [current, levels] = stack.last();
+            stack.removeLast();
+            if (levels <= 0) {
+                return true;
+            }
+            if (current.isArray()) {
+                const QJsonArray arr = current.toArray();
+                for (qsizetype i = 0; i < arr.size(); ++i) {
+                    push(arr.at(i), levels - 1);
+                }
+            } else {
+                const QJsonObject obj = current.toObject();
+                for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+                    push(it.value(), levels - 1);
+                }
             }
+        }
+        return false;
+    }
+
+    // Smaller values are cheaper to encode again than to look up
+    static constexpr qsizetype kMinMemoizedSize = 4;
+
+    static constexpr qsizetype kMinMemoizedBytes = 64;
+
+    // Equal values found in a bucket are looked for among this many candidates only, so values
+    // that collide can't make a write quadratic
+    static constexpr qsizetype kMaxMemoizedCandidates = 4;
+
+    // Hash of an element of a memoized value, scalars and strings by value, anything else by type
+    // only. Values equal by "strictEquals" hash the same.
+    size_t elementHash(const QVariant &value, size_t seed) {
+        const int type = value.userType();
+        const void *data = value.constData();
+        switch (type) {
+            case QMetaType::Bool:
+                return hashCombine(hashCombine(seed, type), *static_cast<const bool *>(data));
             case QMetaType::Int:
+                return hashCombine(hashCombine(seed, type), *static_cast<const int *>(data));
             case QMetaType::UInt:
+                return hashCombine(hashCombine(seed, type), *static_cast<const uint *>(data));
+            case QMetaType::LongLong:
+                return hashCombine(hashCombine(seed, type), *static_cast<const qlonglong *>(data));
+            case QMetaType::ULongLong:
+                return hashCombine(hashCombine(seed, type), *static_cast<const qulonglong *>(data));
             case QMetaType::Double:
-            case QMetaType::Short:
-            case QMetaType::UShort:
-            case QMetaType::Float: {
-                return QJsonValue::fromVariant(value);
-            }
+                return hashCombine(hashCombine(seed, type), *static_cast<const double *>(data));
+            case QMetaType::QString:
+                return hashCombine(hashCombine(seed, type), *static_cast<const QString *>(data));
+            case QMetaType::QByteArray:
+                return hashCombine(hashCombine(seed, type), *static_cast<const QByteArray *>(data));
+            default:
+                break;
+        }
+        return hashCombine(seed, type);
+    }
 
-            case QMetaType::LongLong:
-            case QMetaType::Long: {
-                qlonglong num = value.toLongLong();
-                if (num <= (2LL << 50) && num >= -(2LL << 50)) {
-                    return QJsonValue(double(num));
+    // Hash of the values worth memoizing, over their keys and elements
+    bool memoizedHash(const QVariant &value, size_t &hash) {
+        const int type = value.userType();
+        switch (type) {
+            case QMetaType::QVariantList: {
+                const auto &list = *static_cast<const QVariantList *>(value.constData());
+                if (list.size() < kMinMemoizedSize) {
+                    return false;
                 }
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::LongLong);
-                obj.insert(kKeyValueData, value.toString());
-                return obj;
+                hash = qHash(list.size());
+                for (const auto &item : list) {
+                    hash = elementHash(item, hash);
+                }
+                break;
+            }
+            case QMetaType::QStringList: {
+                const auto &list = *static_cast<const QStringList *>(value.constData());
+                if (list.size() < kMinMemoizedSize) {
+                    return false;
+                }
+                hash = qHashRange(list.begin(), list.end());
+                break;
+            }
+            case QMetaType::QVariantMap: {
+                const auto &map = *static_cast<const QVariantMap *>(value.constData());
+                if (map.size() < kMinMemoizedSize) {
+                    return false;
+                }
+                hash = qHash(map.size());
+                for (auto it = map.cbegin(); it != map.cend(); ++it) {
+                    hash = elementHash(it.value(), hashCombine(hash, it.key()));
+                }
+                break;
+            }
+            case QMetaType::QVariantHash: {
+                const auto &map = *static_cast<const QVariantHash *>(value.constData());
+                if (map.size() < kMinMemoizedSize) {
+                    return false;
+                }
+                // Independent of the iteration order
+                hash = qHash(map.size());
+                for (auto it = map.cbegin(); it != map.cend(); ++it) {
+                    hash += elementHash(it.value(), qHash(it.key()));
+                }
+                break;
+            }
+            case QMetaType::QByteArray: {
+                const auto &bytes = *static_cast<const QByteArray *>(value.constData());
+                if (bytes.size() < kMinMemoizedBytes) {
+                    return false;
+                }
+                hash = qHash(bytes);
+                break;
             }
+            default:
+                return false;
+        }
+        hash = hashCombine(hash, type);
+        return true;
+    }
 
-            case QMetaType::ULongLong:
-            case QMetaType::ULong: {
-                qulonglong num = value.toULongLong();
-                if (num <= (2ULL << 50)) {
-                    return QJsonValue(double(num));
+    // Encodings of the large values met so far in one write, equal values are encoded once
+    class EncodeCache {
+    public:
+        explicit EncodeCache(bool references) : references(references) {
+        }
+
+        QJsonValue encode(const QVariant &value, QStringView group, const QString &key, int depth,
+                          bool &ok) {
+            size_t hash;
+            if (!memoizedHash(value, hash)) {
+                return variantToJsonValue(value, depth, ok);
+            }
+
+            qsizetype candidates = 0;
+            const auto range = lookup.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (++candidates > kMaxMemoizedCandidates) {
+                    return variantToJsonValue(value, depth, ok);
                 }
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::ULongLong);
-                obj.insert(kKeyValueData, value.toString());
-                return obj;
+                const auto &entry = entries.at(*it);
+                // NOTE: a deeper copy could exceed the depth limit, encode it again to find out
+                if (depth > entry.depth || !strictEquals(entry.value, value)) {
+                    continue;
+                }
+                if (references && topGroup(entry.key) == topGroup(group, key)) {
+                    return QJsonObject{
+                        {kKeyValueRef, entry.key}
+                    };
+                }
+                return entry.encoded;
             }
 
-            // Simple json types
-            case QMetaType::QString: {
-                return value.toString();
+            QJsonValue encoded = variantToJsonValue(value, depth, ok);
+            if (!ok) {
+                return {};
             }
-            case QMetaType::QJsonArray: {
-                return value.toJsonArray();
+            Entry entry{value, encoded, {}, depth};
+            if (references) {
+                entry.key = key == kKeyValue ? group.toString() : joinSettingsKey(group, key);
+            }
+            lookup.insert(hash, entries.size());
+            entries.append(std::move(entry));
+            return encoded;
+        }
+
+    private:
+        struct Entry {
+            QVariant value;
+            QJsonValue encoded;
+            QString key;
+            int depth;
+        };
+
+        // References stay inside a top-level group, which is decoded on its own by the watcher
+        static inline QStringView topGroup(QStringView path) {
+            const qsizetype index = path.indexOf(kSeparator);
+            return index < 0 ? path : path.left(index);
+        }
+
+        static inline QStringView topGroup(QStringView group, QStringView key) {
+            return group.isEmpty() ? key : topGroup(group);
+        }
+
+        bool references;
+        QVector<Entry> entries;
+        QMultiHash<size_t, qsizetype> lookup;
+    };
+
+}
+
+namespace QJsonSettingsPrivate {
+
+    // READ
+
+    // Converts the "$data" of a value tagged by type name. Only typed homogeneous arrays are, and
+    // only with an array as their data, anything else goes through stringToVariant.
+    QVariant namedValueToVariant(const QString &typeName, const QJsonValue &value) {
+        if (value.isArray()) {
+            if (typeName == kTypeDoubleList) {
+                return QVariant::fromValue(jsonArrayToTypedList<double>(value));
+            }
+            if (typeName == kTypeIntList) {
+                return QVariant::fromValue(jsonArrayToTypedList<int>(value));
+            }
+        }
+        return _QSettingsPrivate::stringToVariant(value.toString());
+    }
+
+    // Converts the "$data" of a tagged value with the given "$type". Lists tagged by their
+    // runtime type id were written by older versions as "@Variant" strings, so they take the
+    // default path like any other type without a case.
+    QVariant taggedValueToVariant(int type, const QJsonValue &value, int depth, bool &ok) {
+        switch (type) {
+            // Large integer types
+            case QMetaType::LongLong: {
+                return value.toString().toLongLong();
+            }
+            case QMetaType::ULongLong: {
+                return value.toString().toULongLong();
             }
 
             // String list
             case QMetaType::QStringList: {
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QStringList);
-                obj.insert(kKeyValueData, QJsonArray::fromStringList(value.toStringList()));
-                return obj;
+                QStringList result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    result.reserve(arr.size());
+                    for (const auto &v : arr) {
+                        result.append(v.toString());
+                    }
+                }
+                return result;
             }
 
-            // ByteArray
+            // Byte array
             case QMetaType::QByteArray: {
-                const auto &a = value.toByteArray();
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QByteArray);
-                obj.insert(kKeyValueData, QLatin1StringView(a.constData(), a.size()));
-                return obj;
+                QByteArray result;
+                if (value.isString()) {
+                    result = value.toString().toLatin1();
+                }
+                return result;
             }
 
             // Simple structure types
             case QMetaType::QRect: {
-                const auto &r = value.toRect();
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QRect);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              r.x(),
-                                              r.y(),
-                                              r.width(),
-                                              r.height(),
-                                          });
-                return obj;
+                QRect result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 4) {
+                        result = {
+                            arr[0].toInt(),
+                            arr[1].toInt(),
+                            arr[2].toInt(),
+                            arr[3].toInt(),
+                        };
+                    }
+                }
+                return result;
             }
             case QMetaType::QRectF: {
-                const auto &r = value.toRectF();
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QRectF);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              r.x(),
-                                              r.y(),
-                                              r.width(),
-                                              r.height(),
-                                          });
-                return obj;
+                QRectF result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 4) {
+                        result = {
+                            arr[0].toDouble(),
+                            arr[1].toDouble(),
+                            arr[2].toDouble(),
+                            arr[3].toDouble(),
+                        };
+                    }
+                }
+                return result;
             }
             case QMetaType::QSize: {
-                const auto &s = value.toSize();
-                QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QSize);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              s.width(),
-                                              s.height(),
-                                          });
-                return obj;
+                QSize result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 2) {
+                        result = {
+                            arr[0].toInt(),
+                            arr[1].toInt(),
+                        };
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QSizeF: {
+                QSizeF result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 2) {
+                        result = {
+                            arr[0].toDouble(),
+                            arr[1].toDouble(),
+                        };
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QPoint: {
+                QPoint result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 2) {
+                        result = {
+                            arr[0].toInt(),
+                            arr[1].toInt(),
+                        };
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QPointF: {
+                QPointF result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 2) {
+                        result = {
+                            arr[0].toDouble(),
+                            arr[1].toDouble(),
+                        };
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QLine: {
+                QLine result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 4) {
+                        result = {
+                            QPoint(arr[0].toInt(), arr[1].toInt()),
+                            QPoint(arr[2].toInt(), arr[3].toInt()),
+                        };
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QLineF: {
+                QLineF result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 4) {
+                        result = {
+                            QPointF(arr[0].toDouble(), arr[1].toDouble()),
+                            QPointF(arr[2].toDouble(), arr[3].toDouble()),
+                        };
+                    }
+                }
+                return result;
+            }
+
+            // Variant container types
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+            case QMetaType::QVariantPair: {
+                QVariantPair result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    if (arr.size() == 2) {
+                        result = {
+                            jsonValueToVariant(arr[0], depth + 1, ok),
+                            jsonValueToVariant(arr[1], depth + 1, ok),
+                        };
+                    }
+                }
+                return QVariant::fromValue(result);
+            }
+#endif
+            case QMetaType::QVariantList: {
+                QVariantList result;
+                if (value.isArray()) {
+                    const auto &arr = value.toArray();
+                    result.reserve(arr.size());
+                    for (const auto &v : arr) {
+                        result.append(jsonValueToVariant(v, depth + 1, ok));
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QVariantMap: {
+                QVariantMap result;
+                if (value.isObject()) {
+                    const auto &obj = value.toObject();
+                    for (auto it = obj.begin(); it != obj.end(); ++it) {
+                        result.insert(it.key(), jsonValueToVariant(it.value(), depth + 1, ok));
+                    }
+                }
+                return result;
+            }
+            case QMetaType::QVariantHash: {
+                QVariantHash result;
+                if (value.isObject()) {
+                    const auto &obj = value.toObject();
+                    for (auto it = obj.begin(); it != obj.end(); ++it) {
+                        result.insert(it.key(), jsonValueToVariant(it.value(), depth + 1, ok));
+                    }
+                }
+                return result;
+            }
+
+            // Complex json types
+            case QMetaType::QJsonValue: {
+                return (QJsonValue) value;
+            }
+            case QMetaType::QJsonObject: {
+                return value.toObject();
+            }
+            case QMetaType::QJsonDocument: {
+                QJsonDocument doc;
+                if (value.isObject()) {
+                    doc.setObject(value.toObject());
+                } else if (value.isArray()) {
+                    doc.setArray(value.toArray());
+                }
+                return doc;
+            }
+
+            // Date and time types, values ISO 8601 can't keep were written by the stream fallback
+            case QMetaType::QDateTime: {
+                const auto &s = value.toString();
+                if (isLegacyEncoded(s)) {
+                    break;
+                }
+                return QDateTime::fromString(s, Qt::ISODateWithMs);
+            }
+            case QMetaType::QDate: {
+                const auto &s = value.toString();
+                if (isLegacyEncoded(s)) {
+                    break;
+                }
+                return QDate::fromString(s, Qt::ISODate);
+            }
+            case QMetaType::QTime: {
+                const auto &s = value.toString();
+                if (isLegacyEncoded(s)) {
+                    break;
+                }
+                return QTime::fromString(s, Qt::ISODateWithMs);
+            }
+
+            // Other common types
+            case QMetaType::QUuid: {
+                const auto &s = value.toString();
+                if (isLegacyEncoded(s)) {
+                    break;
+                }
+                return QUuid::fromString(s);
+            }
+            case QMetaType::QUrl: {
+                const auto &s = value.toString();
+                if (isLegacyEncoded(s)) {
+                    break;
+                }
+                return QUrl::fromEncoded(s.toLatin1());
+            }
+            case QMetaType::QColor: {
+                // Converted by the converter QtGui registers, like on the write side
+                const auto &s = value.toString();
+                if (isLegacyEncoded(s)) {
+                    break;
+                }
+                QVariant color(s);
+                convertVariant(color, QMetaType::QColor);
+                return color;
+            }
+
+            // Unknown type
+            case QMetaType::UnknownType: {
+                return QVariant();
+            }
+            default:
+                break;
+        }
+        return _QSettingsPrivate::stringToVariant(value.toString());
+    }
+
+    QVariant jsonValueToVariant(const QJsonValue &value, int depth, bool &ok) {
+        if (depth > maxNestingDepth.load(std::memory_order_relaxed)) {
+            ok = false;
+            return {};
+        }
+
+        switch (value.type()) {
+            case QJsonValue::Bool:
+                return value.toBool();
+            case QJsonValue::Double:
+                return value.toDouble();
+            case QJsonValue::String:
+                return value.toString();
+            case QJsonValue::Array:
+                return value.toArray();
+            case QJsonValue::Object: {
+                const auto &obj = value.toObject();
+                if (!isTaggedObject(obj)) {
+                    return obj;
+                }
+
+                // Either form of the tags
+                auto it = obj.find(kKeyValueType);
+                const QString *dataKey = &kKeyValueData;
+                if (it == obj.end()) {
+                    it = obj.find(kKeyCompactValueType);
+                    dataKey = &kKeyCompactValueData;
+                }
+
+                // Typed homogeneous arrays
+                if (it.value().isString()) {
+                    const auto &typeName = it.value().toString();
+                    it = obj.find(*dataKey);
+                    if (it == obj.end()) {
+                        return obj;
+                    }
+                    return namedValueToVariant(typeName, it.value());
+                }
+                int type = it.value().toInt();
+
+                it = obj.find(*dataKey);
+                if (it == obj.end()) {
+                    return obj;
+                }
+                return taggedValueToVariant(type, it.value(), depth, ok);
+            }
+            default:
+                break;
+        }
+        return {};
+    }
+
+    // SCHEMA
+    // Values stored as JSON primitives
+    QVariant decodeNative(const QJsonValue &value, int type, int depth, bool &ok) {
+        Q_UNUSED(type)
+        switch (value.type()) {
+            case QJsonValue::Bool:
+                return value.toBool();
+            case QJsonValue::Double:
+                return value.toDouble();
+            case QJsonValue::String:
+                return value.toString();
+            case QJsonValue::Array:
+                return value.toArray();
+            default:
+                break;
+        }
+        return jsonValueToVariant(value, depth, ok);
+    }
+
+    // Numbers, which may be stored as tagged values if they're too large for a double. A number
+    // out of the range of the type is read as it's stored, converting it would be undefined.
+    QVariant decodeNumber(const QJsonValue &value, int type, int depth, bool &ok) {
+        if (!value.isDouble()) {
+            return jsonValueToVariant(value, depth, ok);
+        }
+        const double num = value.toDouble();
+        switch (type) {
+            case QMetaType::Int:
+                return integerOrDouble<int>(num);
+            case QMetaType::UInt:
+                return integerOrDouble<uint>(num);
+            case QMetaType::Short:
+                return integerOrDouble<short>(num);
+            case QMetaType::UShort:
+                return integerOrDouble<ushort>(num);
+            case QMetaType::Long:
+                return integerOrDouble<long>(num);
+            case QMetaType::ULong:
+                return integerOrDouble<ulong>(num);
+            case QMetaType::LongLong:
+                return integerOrDouble<qlonglong>(num);
+            case QMetaType::ULongLong:
+                return integerOrDouble<qulonglong>(num);
+            case QMetaType::Float:
+                if (!std::isfinite(num) || std::abs(num) <= std::numeric_limits<float>::max()) {
+                    return float(num);
+                }
+                return num;
+            default:
+                break;
+        }
+        QVariant result(num);
+        convertVariant(result, type);
+        return result;
+    }
+
+    // Values stored as {"$type": ..., "$data": ...} or {"$t": ..., "$d": ...}
+    QVariant decodeTagged(const QJsonValue &value, int type, int depth, bool &ok) {
+        if (value.isObject()) {
+            const auto &obj = value.toObject();
+            auto it = obj.find(kKeyValueData);
+            if (it == obj.end() && isTaggedObject(obj)) {
+                it = obj.find(kKeyCompactValueData);
+            }
+
+            // Values tagged by type name carry their type themselves
+            auto typeIt = obj.find(kKeyValueType);
+            if (typeIt == obj.end()) {
+                typeIt = obj.find(kKeyCompactValueType);
+            }
+            if (it != obj.end() && typeIt != obj.end() && typeIt.value().isString()) {
+                return namedValueToVariant(typeIt.value().toString(), it.value());
+            }
+            if (it != obj.end()) {
+                return taggedValueToVariant(type, it.value(), depth, ok);
+            }
+        }
+        return jsonValueToVariant(value, depth, ok);
+    }
+
+    // Values of unknown types
+    QVariant decodeGeneric(const QJsonValue &value, int type, int depth, bool &ok) {
+        Q_UNUSED(type)
+        return jsonValueToVariant(value, depth, ok);
+    }
+
+    // WRITE
+    QJsonValue variantToJsonValue(const QVariant &value, int depth, bool &ok) {
+        if (depth > maxNestingDepth.load(std::memory_order_relaxed)) {
+            ok = false;
+            return {};
+        }
+
+        switch (value.userType()) {
+            // Primitive types
+            case QMetaType::Bool: {
+            }
+            case QMetaType::Int:
+            case QMetaType::UInt:
+            case QMetaType::Double:
+            case QMetaType::Short:
+            case QMetaType::UShort:
+            case QMetaType::Float: {
+                return QJsonValue::fromVariant(value);
+            }
+
+            case QMetaType::LongLong:
+            case QMetaType::Long: {
+                qlonglong num = value.toLongLong();
+                if (num <= (2LL << 50) && num >= -(2LL << 50)) {
+                    return QJsonValue(double(num));
+                }
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::LongLong);
+                obj.insert(valueDataKey(), value.toString());
+                return obj;
+            }
+
+            case QMetaType::ULongLong:
+            case QMetaType::ULong: {
+                qulonglong num = value.toULongLong();
+                if (num <= (2ULL << 50)) {
+                    return QJsonValue(double(num));
+                }
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::ULongLong);
+                obj.insert(valueDataKey(), value.toString());
+                return obj;
+            }
+
+            // Simple json types
+            case QMetaType::QString: {
+                return value.toString();
+            }
+            case QMetaType::QJsonArray: {
+                return value.toJsonArray();
+            }
+
+            // String list
+            case QMetaType::QStringList: {
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QStringList);
+                obj.insert(valueDataKey(), QJsonArray::fromStringList(value.toStringList()));
+                return obj;
+            }
+
+            // ByteArray
+            case QMetaType::QByteArray: {
+                const auto &a = value.toByteArray();
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QByteArray);
+                obj.insert(valueDataKey(), QLatin1String(a.constData(), a.size()));
+                return obj;
+            }
+
+            // Simple structure types
+            case QMetaType::QRect: {
+                const auto &r = value.toRect();
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QRect);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               r.x(),
+                                               r.y(),
+                                               r.width(),
+                                               r.height(),
+                                           });
+                return obj;
+            }
+            case QMetaType::QRectF: {
+                const auto &r = value.toRectF();
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QRectF);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               r.x(),
+                                               r.y(),
+                                               r.width(),
+                                               r.height(),
+                                           });
+                return obj;
+            }
+            case QMetaType::QSize: {
+                const auto &s = value.toSize();
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QSize);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               s.width(),
+                                               s.height(),
+                                           });
+                return obj;
             }
             case QMetaType::QSizeF: {
                 const auto &s = value.toSizeF();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QSizeF);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              s.width(),
-                                              s.height(),
-                                          });
+                obj.insert(valueTypeKey(), QMetaType::QSizeF);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               s.width(),
+                                               s.height(),
+                                           });
                 return obj;
             }
             case QMetaType::QPoint: {
                 const auto &p = value.toPoint();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QPoint);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              p.x(),
-                                              p.y(),
-                                          });
+                obj.insert(valueTypeKey(), QMetaType::QPoint);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               p.x(),
+                                               p.y(),
+                                           });
                 return obj;
             }
             case QMetaType::QPointF: {
                 const auto &p = value.toPointF();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QPointF);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              p.x(),
-                                              p.y(),
-                                          });
+                obj.insert(valueTypeKey(), QMetaType::QPointF);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               p.x(),
+                                               p.y(),
+                                           });
                 return obj;
             }
             case QMetaType::QLine: {
                 const auto &l = value.toLine();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QLine);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              l.x1(),
-                                              l.y1(),
-                                              l.x2(),
-                                              l.y2(),
-                                          });
+                obj.insert(valueTypeKey(), QMetaType::QLine);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               l.x1(),
+                                               l.y1(),
+                                               l.x2(),
+                                               l.y2(),
+                                           });
                 return obj;
             }
             case QMetaType::QLineF: {
                 const auto &l = value.toLineF();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QLineF);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              l.x1(),
-                                              l.y1(),
-                                              l.x2(),
-                                              l.y2(),
-                                          });
+                obj.insert(valueTypeKey(), QMetaType::QLineF);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               l.x1(),
+                                               l.y1(),
+                                               l.x2(),
+                                               l.y2(),
+                                           });
                 return obj;
             }
 
             // Variant container types
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
             case QMetaType::QVariantPair: {
                 const auto &pair = value.value<QVariantPair>();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QVariantPair);
-                obj.insert(kKeyValueData, QJsonArray{
-                                              variantToJsonValue(pair.first),
-                                              variantToJsonValue(pair.second),
-                                          });
+                obj.insert(valueTypeKey(), QMetaType::QVariantPair);
+                obj.insert(valueDataKey(), QJsonArray{
+                                               variantToJsonValue(pair.first, depth + 1, ok),
+                                               variantToJsonValue(pair.second, depth + 1, ok),
+                                           });
                 return obj;
             }
+#endif
             case QMetaType::QVariantList: {
                 const auto &list = value.toList();
                 QJsonArray containerArr;
                 for (const auto &v : list) {
-                    containerArr.append(variantToJsonValue(v));
+                    containerArr.append(variantToJsonValue(v, depth + 1, ok));
                 }
 
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QVariantList);
-                obj.insert(kKeyValueData, containerArr);
+                obj.insert(valueTypeKey(), QMetaType::QVariantList);
+                obj.insert(valueDataKey(), containerArr);
                 return obj;
             }
             case QMetaType::QVariantMap: {
                 const auto &map = value.toMap();
                 QJsonObject containerObj;
                 for (auto it = map.begin(); it != map.end(); ++it) {
-                    containerObj.insert(it.key(), variantToJsonValue(it.value()));
+                    containerObj.insert(it.key(), variantToJsonValue(it.value(), depth + 1, ok));
                 }
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QVariantMap);
-                obj.insert(kKeyValueData, containerObj);
+                obj.insert(valueTypeKey(), QMetaType::QVariantMap);
+                obj.insert(valueDataKey(), containerObj);
                 return obj;
             }
             case QMetaType::QVariantHash: {
                 const auto &hash = value.toHash();
                 QJsonObject containerObj;
                 for (auto it = hash.begin(); it != hash.end(); ++it) {
-                    containerObj.insert(it.key(), variantToJsonValue(it.value()));
+                    containerObj.insert(it.key(), variantToJsonValue(it.value(), depth + 1, ok));
                 }
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QVariantHash);
-                obj.insert(kKeyValueData, containerObj);
+                obj.insert(valueTypeKey(), QMetaType::QVariantHash);
+                obj.insert(valueDataKey(), containerObj);
                 return obj;
             }
 
             // Complex json types
             case QMetaType::QJsonValue: {
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QJsonValue);
-                obj.insert(kKeyValueData, value.toJsonValue());
+                obj.insert(valueTypeKey(), QMetaType::QJsonValue);
+                obj.insert(valueDataKey(), value.toJsonValue());
                 return obj;
             }
             case QMetaType::QJsonObject: {
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QJsonObject);
-                obj.insert(kKeyValueData, value.toJsonObject());
+                obj.insert(valueTypeKey(), QMetaType::QJsonObject);
+                obj.insert(valueDataKey(), value.toJsonObject());
                 return obj;
             }
             case QMetaType::QJsonDocument: {
                 const auto &doc = value.toJsonDocument();
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::QJsonDocument);
+                obj.insert(valueTypeKey(), QMetaType::QJsonDocument);
                 if (doc.isObject()) {
-                    obj.insert(kKeyValueData, doc.object());
+                    obj.insert(valueDataKey(), doc.object());
                 } else if (doc.isArray()) {
-                    obj.insert(kKeyValueData, doc.array());
+                    obj.insert(valueDataKey(), doc.array());
                 } else {
-                    obj.insert(kKeyValueData, QJsonValue::Null);
+                    obj.insert(valueDataKey(), QJsonValue::Null);
+                }
+                return obj;
+            }
+
+            // Date and time types
+            case QMetaType::QDateTime: {
+                const auto &dt = value.toDateTime();
+                // Time zone ids can't be kept by ISO 8601
+                if (dt.timeSpec() == Qt::TimeZone || !isIsoDate(dt.date())) {
+                    break;
+                }
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QDateTime);
+                obj.insert(valueDataKey(), dt.toString(Qt::ISODateWithMs));
+                return obj;
+            }
+            case QMetaType::QDate: {
+                const auto &date = value.toDate();
+                if (!isIsoDate(date)) {
+                    break;
                 }
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QDate);
+                obj.insert(valueDataKey(), date.toString(Qt::ISODate));
+                return obj;
+            }
+            case QMetaType::QTime: {
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QTime);
+                obj.insert(valueDataKey(), value.toTime().toString(Qt::ISODateWithMs));
+                return obj;
+            }
+
+            // Other common types
+            case QMetaType::QUuid: {
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QUuid);
+                obj.insert(valueDataKey(), value.toUuid().toString(QUuid::WithoutBraces));
+                return obj;
+            }
+            case QMetaType::QUrl: {
+                const auto &a = value.toUrl().toEncoded();
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QUrl);
+                obj.insert(valueDataKey(), QLatin1String(a.constData(), a.size()));
+                return obj;
+            }
+            case QMetaType::QColor: {
+                // QColor belongs to QtGui, convert through the converter it registers, and keep
+                // the stream fallback for colors that don't survive the round trip (e.g. HSV)
+                const auto &str = value.toString();
+                QVariant color(str);
+                if (str.isEmpty() || !convertVariant(color, QMetaType::QColor) ||
+                    color != value) {
+                    break;
+                }
+                QJsonObject obj;
+                obj.insert(valueTypeKey(), QMetaType::QColor);
+                obj.insert(valueDataKey(), str);
                 return obj;
             }
 
             // Unknown type
             case QMetaType::UnknownType: {
                 QJsonObject obj;
-                obj.insert(kKeyValueType, QMetaType::UnknownType);
-                obj.insert(kKeyValueData, QJsonValue::Null);
+                obj.insert(valueTypeKey(), QMetaType::UnknownType);
+                obj.insert(valueDataKey(), QJsonValue::Null);
                 return obj;
             }
             default:
                 break;
         }
 
+        // Typed homogeneous arrays
+        if (value.userType() == qMetaTypeId<QList<double>>()) {
+            const auto &list = *static_cast<const QList<double> *>(value.constData());
+            QJsonObject obj;
+            obj.insert(valueTypeKey(), kTypeDoubleList);
+            obj.insert(valueDataKey(), typedListToJsonArray(list));
+            return obj;
+        }
+        if (value.userType() == qMetaTypeId<QList<int>>()) {
+            const auto &list = *static_cast<const QList<int> *>(value.constData());
+            QJsonObject obj;
+            obj.insert(valueTypeKey(), kTypeIntList);
+            obj.insert(valueDataKey(), typedListToJsonArray(list));
+            return obj;
+        }
+
         QJsonObject obj;
-        obj.insert(kKeyValueType, value.metaType().id());
-        obj.insert(kKeyValueData, _QSettingsPrivate::variantToString(value));
+        obj.insert(valueTypeKey(), value.userType());
+        obj.insert(valueDataKey(), _QSettingsPrivate::variantToString(value));
         return obj;
     }
 
-    using SettingsKeys = QVarLengthArray<QStringView, 10 * sizeof(QStringView)>;
 
-    void splitSettingsKeys(SettingsKeys &result, const QStringView &s) {
-        qsizetype start = 0;
-        qsizetype end = s.indexOf(kSeparator);
-        while (end >= 0) {
-            result.append(s.mid(start, end - start));
-            start = end + 1;
-            end = s.indexOf(kSeparator, start);
-        }
-        result.append(s.mid(start));
+    // WRITER
+    Writer::Writer() {
+        rootIndex = allocBranch({});
     }
 
-    class Writer {
-    private:
-        struct NodeRef {
-            int index;
-            bool isLeaf;
-
-            NodeRef(int index = 0, bool isLeaf = false) : index(index), isLeaf(isLeaf) {
-            }
-        };
+    Writer::Writer(const QVariantMap &input) {
+        // Every key is a leaf, and the groups can be counted in one pass over the sorted keys
+        const qsizetype groupCount = estimateGroupCount(input);
+        leafs.reserve(input.size());
+        branches.reserve(groupCount + 1);
 
-        struct LeafNode {
-            QString key;
-            QVariant value;
+        rootIndex = allocBranch({});
+        construct(input, rootIndex);
 
-            LeafNode(QString key = {}, QVariant value = {})
-                : key(std::move(key)), value(std::move(value)){};
-        };
+        reportSizeEstimate(QJsonSettings::SizeEstimate::LeafNodes, input.size(), leafs.size());
+        reportSizeEstimate(QJsonSettings::SizeEstimate::BranchNodes, groupCount + 1,
+                           branches.size());
+    }
 
-        using NodeRefList = QVarLengthArray<NodeRef, 10 * sizeof(NodeRef)>;
+    void Writer::construct(const QVariantMap &input, int branchIndex) {
+        for (auto it = input.begin(); it != input.end(); ++it) {
+            insertPath(branchIndex, it.key(), it.value());
+        }
+    }
 
-        struct BranchNode {
-            QString key;
-            NodeRefList refs;
+    void Writer::insertPath(int branchIndex, QStringView mergedKeys, const QVariant &value) {
+        SettingsKeyIterator keys(mergedKeys);
 
-            BranchNode(QString key = {}, NodeRefList refs = {})
-                : key(std::move(key)), refs(std::move(refs)){};
-        };
+        // Find the desired branch
+        QStringView key = keys.next();
+        while (keys.hasNext()) {
+            branchIndex = findOrCreateBranch(key, branchIndex);
+            key = keys.next();
+        }
+        insert(branchIndex, key, value);
+    }
+
+    // Find the deeper branch with the given key, create new branch if necessary
+    // Returns the index of the found or created branch
+    int Writer::findOrCreateBranch(QStringView key, int branchIndex) {
+        bool keyExists = false;
+        auto pos = indexOf(branches[branchIndex], key, &keyExists);
+        if (keyExists) {
+            const NodeRef &ref = branches[branchIndex].refs[pos];
+            if (ref.isLeaf()) {
+                int orgLeafIndex = ref.index();
+                int nextBranchIndex = allocBranch(key);
 
-        // Emulated heap
-        QVector<LeafNode> leafs;
-        QVector<BranchNode> branches;
+                // Replace leaf with a new branch
+                // NOTE: Don't use "ref" here because "allocBranch" may cause "branches" to
+                // reallocate its storage, which invalidates "ref"
+                replaceRef(branches[branchIndex], pos, {nextBranchIndex, false});
 
-        // Root node index in the emulated heap, normally = 0
-        int rootIndex;
+                // Insert original leaf to the new branch with the reserved key
+                // NOTE: rename after the replacement, the child index may still view the old key
+                leafs[orgLeafIndex].key = kKeyValue;
+                insertRef(branches[nextBranchIndex], 0, {orgLeafIndex, true});
+                branchIndex = nextBranchIndex;
+            } else {
+                branchIndex = ref.index();
+            }
+        } else {
+            int nextBranchIndex = allocBranch(key);
 
-        inline auto allocLeaf(QStringView key, const QVariant &value) {
-            int index = int(leafs.size());
-            leafs.emplace_back(key.toString(), value);
-            return index;
+            // Insert new branch to the parent branch
+            insertRef(branches[branchIndex], pos, {nextBranchIndex, false});
+            branchIndex = nextBranchIndex;
         }
+        return branchIndex;
+    }
+
+    // Insert leaf to the given branch
+    void Writer::insert(int branchIndex, QStringView key, const QVariant &value) {
+        LeafNode &leaf = leafs[leafOf(branchIndex, key)];
+        leaf.value = value;
+        leaf.encoded = QJsonValue(QJsonValue::Undefined);
+    }
 
-        inline auto allocBranch(QStringView key) {
-            int index = int(branches.size());
-            branches.emplace_back(key.toString(), NodeRefList());
-            return index;
+    // Returns the leaf of the key in the given branch, a new leaf is inserted if necessary
+    int Writer::leafOf(int branchIndex, QStringView key) {
+        bool keyExists = false;
+        auto pos = indexOf(branches[branchIndex], key, &keyExists);
+        if (keyExists) {
+            const NodeRef ref = branches[branchIndex].refs[pos];
+            if (ref.isLeaf()) {
+                return ref.index();
+            }
+
+            // Insert leaf to the branch with the reserved key, or return the existing one
+            BranchNode &targetBranch = branches[ref.index()];
+            auto pos1 = indexOf(targetBranch, kKeyValue, &keyExists);
+            if (keyExists) {
+                return targetBranch.refs[pos1].index();
+            }
+            const int leafIndex = allocLeaf(kKeyValue, {});
+            insertRef(targetBranch, pos1, {leafIndex, true});
+            return leafIndex;
         }
 
-        // NOT USED
-        void construct(const QJsonObject &input, int branchIndex) {
-            for (auto it = input.begin(); it != input.end(); ++it) {
-                const auto &key = it.key();
-                const auto &value = it.value();
-                if (value.isObject() && value[kKeyValueType] == QJsonValue::Undefined) {
-                    construct(value.toObject(), findOrCreateBranch(key, branchIndex));
-                    continue;
-                }
+        // Insert new leaf to the parent branch
+        const int leafIndex = allocLeaf(key, {});
+        insertRef(branches[branchIndex], pos, {leafIndex, true});
+        return leafIndex;
+    }
+
+    QVariant Writer::leafValue(const LeafNode &leaf) const {
+        // An assigned or already decoded value wins over the encoding
+        if (!leaf.isEncoded() || leaf.value.isValid()) {
+            return leaf.value;
+        }
+
+        // Can't fail, "load" decodes the values that could exceed the depth limit right away
+        bool ok = true;
+        leaf.value = jsonValueToVariant(leaf.encoded, leaf.depth, ok);
+        return leaf.value;
+    }
+
+    // Find insert position, new children of an indexed branch go to the end
+    qsizetype Writer::indexOf(const BranchNode &branch, QStringView key, bool *keyExists) const {
+        if (!branch.hashIndex.isEmpty()) {
+            const auto it = branch.hashIndex.constFind(key);
+            *keyExists = it != branch.hashIndex.constEnd();
+            return *keyExists ? it.value() : branch.refs.size();
+        }
 
-                insert(branchIndex, key, jsonValueToVariant(it.value()));
+        // Narrow the search down by the key prefixes, ties are resolved by the full keys
+        const auto &prefixes = branch.prefixes;
+        const auto range = std::equal_range(prefixes.begin(), prefixes.end(), keyPrefix(key));
+        const auto begin = branch.refs.begin();
+        const auto end = begin + (range.second - prefixes.begin());
+        const auto it = std::lower_bound(
+            begin + (range.first - prefixes.begin()), end, key,
+            [&](const NodeRef &e, const QStringView &key) { return keyOf(e) < key; });
+
+        *keyExists = (it != end) && keyOf(*it) == key;
+        return it - begin;
+    }
+
+    void Writer::insertRef(BranchNode &branch, qsizetype pos, const NodeRef &ref) {
+        if (!branch.hashIndex.isEmpty()) {
+            branch.hashIndex.insert(keyOf(ref), branch.refs.size());
+            branch.refs.append(ref);
+            branch.sorted = false;
+            return;
+        }
+
+        branch.refs.insert(pos, ref);
+        branch.prefixes.insert(pos, keyPrefix(keyOf(ref)));
+        if (branch.refs.size() >= kIndexedBranchSize) {
+            branch.hashIndex.reserve(branch.refs.size() * 2);
+            for (qsizetype i = 0; i < branch.refs.size(); ++i) {
+                branch.hashIndex.insert(keyOf(branch.refs[i]), i);
             }
+            branch.prefixes.clear();
+            branch.prefixes.squeeze();
         }
+    }
 
-        void construct(const QVariantMap &input, int branchIndex) {
-            for (auto it = input.begin(); it != input.end(); ++it) {
-                const auto &mergedKeys = it.key();
-                SettingsKeys keys;
-                splitSettingsKeys(keys, mergedKeys);
-                if (keys.isEmpty()) {
-                    continue;
-                }
+    void Writer::replaceRef(BranchNode &branch, qsizetype pos, const NodeRef &ref) {
+        if (!branch.hashIndex.isEmpty()) {
+            // Re-insert, QHash keeps the old key on assignment and it may be about to go away
+            branch.hashIndex.remove(keyOf(branch.refs[pos]));
+            branch.hashIndex.insert(keyOf(ref), pos);
+        }
+        branch.refs[pos] = ref;
+    }
 
-                const auto &value = it.value();
+    void Writer::removeRef(BranchNode &branch, qsizetype pos) {
+        if (branch.hashIndex.isEmpty()) {
+            branch.refs.remove(pos);
+            branch.prefixes.remove(pos);
+            return;
+        }
 
-                // Find the desired branch
-                int nextBranchIndex = branchIndex;
-                qsizetype i = 0;
-                qsizetype end = keys.size() - 1;
-                for (; i < end; ++i) {
-                    nextBranchIndex = findOrCreateBranch(keys[i], nextBranchIndex);
-                }
-                insert(nextBranchIndex, keys.back(), value);
+        // The order doesn't matter until the branch is sorted, move the last child into the gap
+        branch.hashIndex.remove(keyOf(branch.refs[pos]));
+        const qsizetype last = branch.refs.size() - 1;
+        if (pos != last) {
+            branch.refs[pos] = branch.refs[last];
+            branch.hashIndex[keyOf(branch.refs[pos])] = pos;
+            branch.sorted = false;
+        }
+        branch.refs.removeLast();
+    }
+
+    // Reserves a branch for the given number of children, so a branch loaded from a document
+    // is filled without growing
+    void Writer::reserveChildren(BranchNode &branch, qsizetype count) {
+        branch.refs.reserve(count);
+        if (count < kIndexedBranchSize) {
+            branch.prefixes.reserve(count);
+        }
+    }
+
+    const Writer::NodeRefList &Writer::sortedRefs(const BranchNode &branch) const {
+        if (!branch.sorted) {
+            std::sort(branch.refs.begin(), branch.refs.end(),
+                      [&](const NodeRef &a, const NodeRef &b) { return keyOf(a) < keyOf(b); });
+            for (qsizetype i = 0; i < branch.refs.size(); ++i) {
+                branch.hashIndex[keyOf(branch.refs[i])] = i;
             }
+            branch.sorted = true;
         }
+        return branch.refs;
+    }
 
-        // Find the deeper branch with the given key, create new branch if necessary
-        // Returns the index of the found or created branch
-        int findOrCreateBranch(QStringView key, int branchIndex) {
+    // Returns the branch at the first "count" keys, or -1 if there's none
+    int Writer::findBranch(const SettingsKeys &keys, qsizetype count) const {
+        int branchIndex = rootIndex;
+        for (qsizetype i = 0; i < count; ++i) {
+            const auto &branch = branches[branchIndex];
             bool keyExists = false;
-            auto pos = indexOf(branches[branchIndex].refs, key, &keyExists);
-            if (keyExists) {
-                const NodeRef &ref = branches[branchIndex].refs[pos];
-                if (ref.isLeaf) {
-                    int orgLeafIndex = ref.index;
-                    int nextBranchIndex = allocBranch(key);
-
-                    // Insert original leaf to the new branch with the reserved key
-                    leafs[orgLeafIndex].key = kKeyValue;
-                    branches[nextBranchIndex].refs.append({orgLeafIndex, true});
-
-                    // Replace leaf with a new branch
-                    // NOTE: Don't use "ref" here because "allocBranch" may cause "branches" to
-                    // reallocate its storage, which invalidates "ref"
-                    branches[branchIndex].refs[pos] = {nextBranchIndex, false};
-                    branchIndex = nextBranchIndex;
+            auto pos = indexOf(branch, keys[i], &keyExists);
+            if (!keyExists || branch.refs[pos].isLeaf()) {
+                return -1;
+            }
+            branchIndex = branch.refs[pos].index();
+        }
+        return branchIndex;
+    }
+
+    // Returns the number of nodes in the subtree
+    int Writer::countNodes(const NodeRef &ref) const {
+        if (ref.isLeaf()) {
+            return 1;
+        }
+        int count = 0;
+        QVarLengthArray<int, 32> stack;
+        stack.append(ref.index());
+        while (!stack.isEmpty()) {
+            const auto &refs = branches[stack.last()].refs;
+            stack.removeLast();
+            ++count;
+            for (const auto &child : refs) {
+                if (child.isLeaf()) {
+                    ++count;
                 } else {
-                    branchIndex = ref.index;
+                    stack.append(child.index());
                 }
-            } else {
-                int nextBranchIndex = allocBranch(key);
-
-                // Insert new branch to the parent branch
-                branches[branchIndex].refs.insert(pos, {nextBranchIndex, false});
-                branchIndex = nextBranchIndex;
             }
-            return branchIndex;
         }
+        return count;
+    }
 
-        // Insert leaf to the given branch
-        void insert(int branchIndex, QStringView key, const QVariant &value) {
-            auto &refs = branches[branchIndex].refs;
-            bool keyExists = false;
-            auto pos = indexOf(refs, key, &keyExists);
-            if (keyExists) {
-                NodeRef &ref = refs[pos];
-                if (ref.isLeaf) {
-                    // Replace leaf with a new leaf
-                    leafs[ref.index].value = value;
+    // Moves the reachable nodes into fresh storage, dropping the ones detached by "remove"
+    void Writer::compact() {
+        QVector<LeafNode> newLeafs;
+        QVector<BranchNode> newBranches;
+        newBranches.append(std::move(branches[rootIndex]));
+
+        QVarLengthArray<int, 32> stack;
+        stack.append(0);
+        while (!stack.isEmpty()) {
+            const int index = stack.last();
+            stack.removeLast();
+
+            // NOTE: access by index, appending to "newBranches" may reallocate its storage
+            for (qsizetype i = 0; i < newBranches[index].refs.size(); ++i) {
+                const NodeRef ref = newBranches[index].refs[i];
+                int newIndex;
+                if (ref.isLeaf()) {
+                    newIndex = int(newLeafs.size());
+                    newLeafs.append(std::move(leafs[ref.index()]));
                 } else {
-                    // Insert leaf to the branch with the reserved key
-                    NodeRefList &targetBranchRefs = branches[ref.index].refs;
-                    auto pos1 = indexOf(targetBranchRefs, kKeyValue, &keyExists);
-                    targetBranchRefs.insert(pos1, {allocLeaf(kKeyValue, value), true});
+                    newIndex = int(newBranches.size());
+                    newBranches.append(std::move(branches[ref.index()]));
+                    stack.append(newIndex);
                 }
-            } else {
-                // Insert new leaf to the parent branch
-                refs.insert(pos, {allocLeaf(key, value), true});
+                newBranches[index].refs[i] = NodeRef(newIndex, ref.isLeaf());
             }
         }
 
-        // Find insert position
-        qsizetype indexOf(const NodeRefList &refs, const QStringView &key, bool *keyExists) const {
-            const auto begin = refs.begin();
-            const auto end = refs.end();
-            const auto it = std::lower_bound(
-                refs.begin(), refs.end(), key, [&](const NodeRef &e, const QStringView &key) {
-                    return (e.isLeaf ? leafs[e.index].key : branches[e.index].key) < key;
-                });
+        leafs = std::move(newLeafs);
+        branches = std::move(newBranches);
+        rootIndex = 0;
+        garbage = 0;
+    }
 
-            *keyExists =
-                (it != end) && (it->isLeaf ? leafs[it->index].key : branches[it->index].key) == key;
-            return it - begin;
+    bool Writer::toJsonObjectImpl(QJsonObject &result) const {
+        const int maxDepth = maxNestingDepth.load(std::memory_order_relaxed);
+        const bool references = valueReferencesEnabled.load(std::memory_order_relaxed);
+        EncodeCache cache(references);
+        const bool keep = keepEncodings && !references;
+
+        QVarLengthArray<JsonFrame, 32> stack;
+
+        // Path of the current branch, names the first occurrences of memoized values
+        QString group;
+        stack.append({&sortedRefs(branches[rootIndex]), 0, {}, {}, 0});
+        bool ok = true;
+        while (true) {
+            auto &frame = stack.last();
+            if (frame.index < frame.refs->size()) {
+                const auto &ref = frame.refs->at(frame.index++);
+                if (ref.isLeaf()) {
+                    const auto &leaf = leafs[ref.index()];
+                    const int depth = int(stack.size() - 1);
+                    // Loaded leafs that weren't modified are written back as they were read
+                    QJsonValue value = leaf.isEncoded()
+                                           ? leaf.encoded
+                                           : cache.encode(leaf.value, group, leaf.key, depth, ok);
+                    if (!ok) {
+                        return false;
+                    }
+                    if (keep && !leaf.isEncoded()) {
+                        leaf.encoded = value;
+                        leaf.depth = depth;
+                    }
+                    frame.obj.insert(escapeKey(leaf.key), value);
+                } else {
+                    if (stack.size() > maxDepth) {
+                        return false;
+                    }
+                    // NOTE: "frame" is invalidated by the append
+                    const auto &branch = branches[ref.index()];
+                    const qsizetype groupSize = group.size();
+                    if (!group.isEmpty()) {
+                        group.append(kSeparator);
+                    }
+                    group.append(branch.key);
+                    stack.append({&sortedRefs(branch), 0, branch.key, {}, groupSize});
+                }
+                continue;
+            }
+
+            // All children converted, move the object into the parent
+            if (stack.size() == 1) {
+                result = std::move(frame.obj);
+                return true;
+            }
+            JsonFrame done = std::move(frame);
+            group.truncate(done.groupSize);
+            stack.removeLast();
+            stack.last().obj.insert(escapeKey(done.key), done.obj);
         }
+    }
 
-        QJsonObject toJsonObjectImpl(const NodeRefList &refs) const {
-            QJsonObject obj;
-            for (const auto &ref : refs) {
-                if (ref.isLeaf) {
-                    const auto &leaf = leafs[ref.index];
-                    obj.insert(leaf.key, variantToJsonValue(leaf.value));
-                } else {
-                    const auto &branch = branches[ref.index];
-                    obj.insert(branch.key, toJsonObjectImpl(branch.refs));
+    void Writer::toVariantMapImpl(QVariantMap &result) const {
+        QVarLengthArray<MapFrame, 32> stack;
+
+        // Path of the current branch, each frame remembers the length to restore when it's done
+        QString group;
+        stack.append({&sortedRefs(branches[rootIndex]), 0, 0});
+        while (!stack.isEmpty()) {
+            auto &frame = stack.last();
+            if (frame.index == frame.refs->size()) {
+                group.truncate(frame.groupSize);
+                stack.removeLast();
+                continue;
+            }
+
+            const auto &ref = frame.refs->at(frame.index++);
+            if (ref.isLeaf()) {
+                // Children are visited in key order, so the new key mostly goes to the end
+                const auto &leaf = leafs[ref.index()];
+                result.insert(result.constEnd(),
+                              leaf.key == kKeyValue ? QStringView(group).toString()
+                                                    : joinSettingsKey(group, leaf.key),
+                              leafValue(leaf));
+            } else {
+                const auto &branch = branches[ref.index()];
+                const qsizetype groupSize = group.size();
+                if (!group.isEmpty()) {
+                    group.append(kSeparator);
                 }
+                group.append(branch.key);
+                stack.append({&sortedRefs(branch), 0, groupSize});
             }
-            return obj;
         }
+    }
 
-        void toVariantMapImpl(QVariantMap &result, const NodeRefList &branch,
-                              QStringList &keys) const {
-            for (const auto &ref : branch) {
-                if (ref.isLeaf) {
-                    auto mergedKeys = keys.join(kSeparator);
-                    const auto &leaf = leafs[ref.index];
-                    if (leaf.key == kKeyValue) {
-                        result[mergedKeys] = leaf.value;
-                    } else {
-                        if (!mergedKeys.isEmpty()) {
-                            mergedKeys.append(kSeparator);
-                        }
-                        result[mergedKeys + leaf.key] = leaf.value;
-                    }
-                } else {
-                    const auto &branch = branches[ref.index];
-                    keys << branch.key;
-                    toVariantMapImpl(result, branch.refs, keys);
-                    keys.removeLast();
+    bool Writer::load(const QJsonObject &input, qsizetype fileSize) {
+        clear();
+
+        // Estimate the node counts from the file size and the averages of the previous documents
+        qsizetype leafEstimate = 0;
+        qsizetype branchEstimate = 0;
+        if (fileSize > 0) {
+            leafEstimate = fileSize / averageLeafBytes.load(std::memory_order_relaxed) + 1;
+            branchEstimate = leafEstimate / averageBranchLeafs.load(std::memory_order_relaxed) + 1;
+            leafs.reserve(leafEstimate);
+            branches.reserve(branchEstimate);
+        }
+        reserveChildren(branches[rootIndex], input.size());
+
+        const int maxDepth = maxNestingDepth.load(std::memory_order_relaxed);
+
+        QVarLengthArray<LoadFrame, 32> stack;
+        QVector<PendingReference> references;
+        stack.append({input, 0, rootIndex});
+        while (!stack.isEmpty()) {
+            auto &frame = stack.last();
+            if (frame.index == frame.obj.size()) {
+                stack.removeLast();
+                continue;
+            }
+
+            // NOTE: copy the entry, "frame" is invalidated when a child is pushed
+            const auto it = frame.obj.constBegin() + frame.index++;
+            const QString key = unescapeKey(it.key());
+            const QJsonValue value = it.value();
+            const int branchIndex = frame.branchIndex;
+            const int depth = int(stack.size() - 1);
+
+            // Same rules as the reader, "$value" is kept as the leaf holding the group's own value
+            if (key != kKeyValue && isBranchValue(value)) {
+                if (depth >= maxDepth) {
+                    return false;
+                }
+                const QJsonObject obj = value.toObject();
+                const int childIndex = findOrCreateBranch(key, branchIndex);
+                reserveChildren(branches[childIndex], obj.size());
+                stack.append({obj, 0, childIndex});
+                continue;
+            }
+            if (isReferenceValue(value)) {
+                references.append({branchIndex, key, value, depth});
+                continue;
+            }
+
+            // Keep the value encoded, it shares the document's storage until it's read. A value
+            // nested too deep to rule out a decoding failure is decoded now, so that it fails the
+            // load as it would without the deferred decoding.
+            LeafNode &leaf = leafs[leafOf(branchIndex, key)];
+            leaf.encoded = value;
+            leaf.depth = depth;
+            if (exceedsNesting(value, maxDepth - depth)) {
+                bool ok = true;
+                leaf.value = jsonValueToVariant(value, depth, ok);
+                if (!ok) {
+                    return false;
                 }
             }
         }
 
-    public:
-        explicit Writer(const QJsonObject &input) {
-            rootIndex = allocBranch({});
-            construct(input, rootIndex);
+        // The targets are looked up before any reference is resolved, so a reference to a
+        // reference is not found
+        QVector<LeafNode> targets(references.size());
+        QVector<bool> found(references.size());
+        for (qsizetype i = 0; i < references.size(); ++i) {
+            if (const LeafNode *target = findLeaf(references[i].value[kKeyValueRef].toString())) {
+                targets[i] = *target;
+                found[i] = true;
+            }
+        }
+        bool ok = true;
+        for (qsizetype i = 0; i < references.size(); ++i) {
+            const auto &reference = references[i];
+            if (found[i]) {
+                LeafNode &leaf = leafs[leafOf(reference.branchIndex, reference.key)];
+                leaf.value = targets[i].value;
+                leaf.encoded = targets[i].encoded;
+                leaf.depth = targets[i].depth;
+                continue;
+            }
+
+            // Not a valid reference, read it the way it was read before references existed
+            if (reference.key == kKeyValue) {
+                insert(reference.branchIndex, reference.key,
+                       jsonValueToVariant(reference.value, reference.depth, ok));
+            } else {
+                insert(findOrCreateBranch(reference.key, reference.branchIndex), kKeyValueRef,
+                       jsonValueToVariant(reference.value[kKeyValueRef], reference.depth + 1, ok));
+            }
+            if (!ok) {
+                return false;
+            }
         }
 
-        explicit Writer(const QVariantMap &input) {
-            rootIndex = allocBranch({});
-            construct(input, rootIndex);
+        if (fileSize > 0) {
+            reportSizeEstimate(QJsonSettings::SizeEstimate::LeafNodes, leafEstimate, leafs.size());
+            reportSizeEstimate(QJsonSettings::SizeEstimate::BranchNodes, branchEstimate,
+                               branches.size());
+            updateAverages(fileSize, leafs.size(), branches.size());
         }
+        return true;
+    }
 
-        QVariantMap toVariantMap() const {
-            QVariantMap result;
-            QStringList keys;
-            toVariantMapImpl(result, branches[rootIndex].refs, keys);
-            return result;
+    QVariantMap Writer::toVariantMap() const {
+        QVariantMap result;
+        toVariantMapImpl(result);
+        return result;
+    }
+
+    bool Writer::toJsonObject(QJsonObject &result) const {
+        return toJsonObjectImpl(result);
+    }
+
+    bool Writer::find(QStringView key, QVariant *value) const {
+        const LeafNode *leaf = findLeaf(key);
+        if (!leaf) {
+            return false;
         }
+        if (value) {
+            *value = leafValue(*leaf);
+        }
+        return true;
+    }
 
-        QJsonObject toJsonObject() const {
-            return toJsonObjectImpl(branches[rootIndex].refs);
+    const Writer::LeafNode *Writer::findLeaf(QStringView key) const {
+        SettingsKeys keys;
+        splitSettingsPath(keys, key);
+        if (keys.isEmpty()) {
+            return nullptr;
         }
-    };
+
+        int branchIndex = findBranch(keys, keys.size() - 1);
+        if (branchIndex < 0) {
+            return nullptr;
+        }
+
+        const auto *branch = &branches[branchIndex];
+        bool keyExists = false;
+        auto pos = indexOf(*branch, keys.back(), &keyExists);
+        if (!keyExists) {
+            return nullptr;
+        }
+        if (!branch->refs[pos].isLeaf()) {
+            // A group that also has a value of its own
+            branch = &branches[branch->refs[pos].index()];
+            pos = indexOf(*branch, kKeyValue, &keyExists);
+            if (!keyExists) {
+                return nullptr;
+            }
+        }
+        return &leafs[branch->refs[pos].index()];
+    }
+
+    void Writer::insertPath(QStringView key, const QVariant &value) {
+        insertPath(rootIndex, key, value);
+    }
+
+    void Writer::setValue(QStringView key, const QVariant &value) {
+        SettingsKeyIterator keys(key, true);
+        if (!keys.hasNext()) {
+            return;
+        }
+
+        int branchIndex = rootIndex;
+        QStringView segment = keys.next();
+        while (keys.hasNext()) {
+            branchIndex = findOrCreateBranch(segment, branchIndex);
+            segment = keys.next();
+        }
+        insert(branchIndex, segment, value);
+    }
+
+    // Removes the key and all of its subkeys like QSettings does, groups left empty are dropped
+    void Writer::remove(QStringView key) {
+        SettingsKeys keys;
+        splitSettingsPath(keys, key);
+        if (keys.isEmpty()) {
+            clear();
+            return;
+        }
+        removePath(keys, false);
+    }
+
+    void Writer::removeValue(QStringView key) {
+        SettingsKeys keys;
+        splitSettingsPath(keys, key);
+        if (!keys.isEmpty()) {
+            removePath(keys, true);
+        }
+    }
+
+    void Writer::removePath(const SettingsKeys &keys, bool valueOnly) {
+        // Branches along the path, the root comes first
+        QVarLengthArray<int, 32> path;
+        path.append(rootIndex);
+        for (qsizetype i = 0; i < keys.size() - 1; ++i) {
+            const auto &branch = branches[path.last()];
+            bool keyExists = false;
+            auto pos = indexOf(branch, keys[i], &keyExists);
+            if (!keyExists || branch.refs[pos].isLeaf()) {
+                return;
+            }
+            path.append(branch.refs[pos].index());
+        }
+
+        bool keyExists = false;
+        auto pos = indexOf(branches[path.last()], keys.back(), &keyExists);
+        if (!keyExists) {
+            return;
+        }
+        if (valueOnly && !branches[path.last()].refs[pos].isLeaf()) {
+            // A group that also has a value of its own
+            path.append(branches[path.last()].refs[pos].index());
+            pos = indexOf(branches[path.last()], kKeyValue, &keyExists);
+            if (!keyExists) {
+                return;
+            }
+        }
+        garbage += countNodes(branches[path.last()].refs[pos]);
+        removeRef(branches[path.last()], pos);
+
+        // NOTE: the branch at "path[i]" has the key "keys[i - 1]" in its parent
+        qsizetype i = path.size() - 1;
+        for (; i > 0 && branches[path[i]].refs.isEmpty(); --i) {
+            pos = indexOf(branches[path[i - 1]], keys[i - 1], &keyExists);
+            removeRef(branches[path[i - 1]], pos);
+            ++garbage;
+        }
+
+        const auto &rest = branches[path[i]].refs;
+        if (valueOnly && i > 0 && rest.size() == 1 && rest[0].isLeaf() &&
+            leafs[rest[0].index()].key == kKeyValue) {
+            // The value is all that's left of the group, it takes the place of the group
+            const int leafIndex = rest[0].index();
+            pos = indexOf(branches[path[i - 1]], keys[i - 1], &keyExists);
+            // NOTE: rename before the replacement, the parent's index views the new child's key
+            leafs[leafIndex].key = branches[path[i]].key;
+            replaceRef(branches[path[i - 1]], pos, {leafIndex, true});
+            ++garbage;
+        }
+
+        // Reclaim the storage once most of it is unreachable
+        if (garbage > 64 && garbage * 2 > leafs.size() + branches.size()) {
+            compact();
+        }
+    }
+
+    void Writer::clear() {
+        leafs.clear();
+        branches.clear();
+        garbage = 0;
+        rootIndex = allocBranch({});
+    }
+
+    bool Writer::isEmpty() const {
+        return branches[rootIndex].refs.isEmpty();
+    }
+
+    QStringList Writer::childKeys(QStringView group) const {
+        SettingsKeys keys;
+        splitSettingsPath(keys, group);
+        int branchIndex = findBranch(keys, keys.size());
+        if (branchIndex < 0) {
+            return {};
+        }
+
+        QStringList result;
+        for (const auto &ref : sortedRefs(branches[branchIndex])) {
+            if (ref.isLeaf()) {
+                const auto &leafKey = leafs[ref.index()].key;
+                if (leafKey != kKeyValue) {
+                    result.append(leafKey);
+                }
+                continue;
+            }
+
+            // A group with a value of its own is a key as well
+            bool keyExists = false;
+            indexOf(branches[ref.index()], kKeyValue, &keyExists);
+            if (keyExists) {
+                result.append(branches[ref.index()].key);
+            }
+        }
+        return result;
+    }
+
+    QStringList Writer::childGroups(QStringView group) const {
+        SettingsKeys keys;
+        splitSettingsPath(keys, group);
+        int branchIndex = findBranch(keys, keys.size());
+        if (branchIndex < 0) {
+            return {};
+        }
+
+        QStringList result;
+        for (const auto &ref : sortedRefs(branches[branchIndex])) {
+            if (ref.isLeaf()) {
+                continue;
+            }
+
+            // A branch holding only the value of the key itself is not a group
+            const auto &branch = branches[ref.index()];
+            if (branch.refs.size() == 1 && branch.refs[0].isLeaf() &&
+                leafs[branch.refs[0].index()].key == kKeyValue) {
+                continue;
+            }
+            result.append(branch.key);
+        }
+        return result;
+    }
+
+}
+
+namespace {
+
+    // An empty schema that decodes unknown keys is the same as none, and cheaper
+    const QJsonSettingsSchemaData *activeSchema(const QJsonSettingsSchema *schema) {
+        if (schema && (!schema->isEmpty() ||
+                       schema->unknownKeyPolicy() != QJsonSettingsSchema::DecodeUnknownKeys)) {
+            return QJsonSettingsSchemaData::get(*schema);
+        }
+        return nullptr;
+    }
 
     class Reader {
     private:
-        void toVariantMapImpl(const QJsonObject &input, QStringList &names,
-                              QVariantMap &result) const {
-            for (auto it = input.begin(); it != input.end(); ++it) {
-                const auto &key = it.key();
-                const auto &value = it.value();
+        struct Frame {
+            QJsonObject obj;
+            qsizetype index;
+            qsizetype groupSize;
+
+            // Whether the values of the group are converted, see "GroupFilter"
+            bool included;
+        };
+
+        // Reference met during the walk, resolved once all values are decoded
+        struct Reference {
+            QString key;
+            QJsonValue value;
+            int depth;
+            bool isGroupValue;
+        };
+
+        bool toVariantMapImpl(QVariantMap &result) const {
+            const int maxDepth = maxNestingDepth.load(std::memory_order_relaxed);
+
+            QVarLengthArray<Frame, 32> stack;
+
+            // Path of the current group, each frame remembers the length to restore when it's done
+            QString group;
+            stack.append({input, 0, 0, !groups || filter == SkipGroups});
+            QVector<Reference> references;
+            bool ok = true;
+            while (!stack.isEmpty()) {
+                auto &frame = stack.last();
+                if (frame.index == frame.obj.size()) {
+                    group.truncate(frame.groupSize);
+                    stack.removeLast();
+                    continue;
+                }
+
+                // NOTE: copy the entry, "frame" is invalidated when a child is pushed
+                const auto it = frame.obj.constBegin() + frame.index++;
+                const QString key = unescapeKey(it.key());
+                const QJsonValue value = it.value();
+                const int depth = int(stack.size() - 1);
+                const bool included = frame.included;
                 if (key == kKeyValue) {
-                    result.insert(names.join(kSeparator), jsonValueToVariant(value));
+                    if (!included) {
+                        continue;
+                    }
+                    insertLeaf(result, references, QStringView(group).toString(), value, depth,
+                               true, ok);
+                } else if (isBranchValue(value)) {
+                    if (depth >= maxDepth) {
+                        return false;
+                    }
+                    const qsizetype groupSize = group.size();
+                    if (!group.isEmpty()) {
+                        group.append(kSeparator);
+                    }
+                    group.append(key);
+
+                    bool childIncluded = included;
+                    if (groups) {
+                        const bool listed = groups->contains(group);
+                        if (filter == SkipGroups && listed) {
+                            group.truncate(groupSize);
+                            continue;
+                        }
+                        if (filter == OnlyGroups && !included) {
+                            // Groups outside the listed ones are only entered on the way to them
+                            childIncluded = listed;
+                            if (!listed && !leadsToGroup(group)) {
+                                group.truncate(groupSize);
+                                continue;
+                            }
+                        }
+                    }
+                    stack.append({value.toObject(), 0, groupSize, childIncluded});
+                    continue;
+                } else if (!included) {
                     continue;
+                } else {
+                    insertLeaf(result, references, joinSettingsKey(group, key), value, depth, false,
+                               ok);
+                }
+                if (!ok) {
+                    return false;
                 }
+            }
 
-                if (value.isObject() && value[kKeyValueType] == QJsonValue::Undefined) {
-                    names.append(key);
-                    toVariantMapImpl(value.toObject(), names, result);
-                    names.removeLast();
+            // The targets are looked up before any reference is resolved, so a reference to a
+            // reference is not found
+            QVector<QVariant> targets(references.size());
+            QVector<bool> found(references.size());
+            for (qsizetype i = 0; i < references.size(); ++i) {
+                auto it = result.constFind(references[i].value[kKeyValueRef].toString());
+                if (it != result.constEnd()) {
+                    targets[i] = it.value();
+                    found[i] = true;
+                }
+            }
+            for (qsizetype i = 0; i < references.size(); ++i) {
+                const auto &reference = references[i];
+                if (found[i]) {
+                    result.insert(reference.key, targets[i]);
                     continue;
                 }
 
-                names.append(key);
-                result.insert(names.join(kSeparator), jsonValueToVariant(it.value()));
-                names.removeLast();
+                // Not a valid reference, read it the way it was read before references existed
+                if (reference.isGroupValue) {
+                    result.insert(reference.key, leafValue(reference.value, reference.depth, ok));
+                } else {
+                    const QJsonValue target = reference.value[kKeyValueRef];
+                    result.insert(internKey(joinSettingsKey(reference.key, kKeyValueRef)),
+                                  leafValue(target, reference.depth + 1, ok));
+                }
+                if (!ok) {
+                    return false;
+                }
             }
+            return true;
+        }
+
+        // QMap can't be reserved, but the keys of a group arrive in order, so the end of the map
+        // is passed as a hint and saves most of the lookups
+        static void insertValue(QVariantMap &result, const QString &key, const QVariant &value) {
+            result.insert(result.end(), key, value);
         }
 
+        void insertLeaf(QVariantMap &result, QVector<Reference> &references, const QString &key,
+                        const QJsonValue &value, int depth, bool isGroupValue, bool &ok) const {
+            // A reference takes the decoded value of its target, whatever the schema says
+            if (isReferenceValue(value)) {
+                if (groups && filter == OnlyGroups) {
+                    ok = false;
+                    return;
+                }
+                if (schema && !schema->entries.contains(key) &&
+                    schema->unknownKeyPolicy != QJsonSettingsSchema::DecodeUnknownKeys) {
+                    ok = schema->unknownKeyPolicy == QJsonSettingsSchema::SkipUnknownKeys;
+                    return;
+                }
+                references.append({internKey(key), value, depth, isGroupValue});
+                return;
+            }
+
+            if (schema) {
+                auto it = schema->entries.constFind(key);
+                if (it != schema->entries.constEnd()) {
+                    insertValue(result, internKey(key), it->decoder(value, it->type, depth, ok));
+                    return;
+                }
+                switch (schema->unknownKeyPolicy) {
+                    case QJsonSettingsSchema::SkipUnknownKeys:
+                        return;
+                    case QJsonSettingsSchema::RejectUnknownKeys:
+                        ok = false;
+                        return;
+                    default:
+                        break;
+                }
+            }
+            insertValue(result, internKey(key), leafValue(value, depth, ok));
+        }
+
+        bool leadsToGroup(const QString &group) const {
+            for (const auto &listed : std::as_const(*groups)) {
+                if (listed.size() > group.size() && listed.startsWith(group) &&
+                    listed[group.size()] == kSeparator) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline QString internKey(const QString &key) const {
+            return pool ? pool->intern(key) : key;
+        }
+
+        QVariant leafValue(const QJsonValue &value, int depth, bool &ok) const {
+            if (pool && value.isString()) {
+                const auto &str = value.toString();
+                return str.size() <= kMaxInternedValueLength ? pool->intern(str) : str;
+            }
+            return jsonValueToVariant(value, depth, ok);
+        }
+
+        StringPool *pool;
+        const QJsonSettingsSchemaData *schema;
+        const QStringList *groups;
+        GroupFilter filter;
+
     public:
-        explicit Reader(const QJsonObject &input) : input(input) {
+        explicit Reader(const QJsonObject &input, const QJsonSettingsSchemaData *schema = nullptr,
+                        const QStringList *groups = nullptr, GroupFilter filter = SkipGroups)
+            : pool(stringInterningEnabled.load(std::memory_order_relaxed) ? &stringPool()
+                                                                          : nullptr),
+              schema(schema), groups(groups), filter(filter), input(input) {
         }
 
-        QVariantMap toVariantMap() const {
-            QVariantMap result;
-            QStringList names;
-            toVariantMapImpl(input, names, result);
-            return result;
+        // Returns false if the input is nested deeper than the limit or has a key rejected by the
+        // schema
+        bool toVariantMap(QVariantMap &result) const {
+            return toVariantMapImpl(result);
         }
 
         const QJsonObject &input;
@@ -945,7 +2256,400 @@ namespace {
 
 }
 
+namespace QJsonSettingsPrivate {
+
+    Decoder decoderForType(int type) {
+        switch (type) {
+            case QMetaType::Bool:
+            case QMetaType::Double:
+            case QMetaType::QString:
+            case QMetaType::QJsonArray:
+                return decodeNative;
+
+            case QMetaType::Int:
+            case QMetaType::UInt:
+            case QMetaType::Short:
+            case QMetaType::UShort:
+            case QMetaType::Long:
+            case QMetaType::ULong:
+            case QMetaType::LongLong:
+            case QMetaType::ULongLong:
+            case QMetaType::Float:
+                return decodeNumber;
+
+            // Objects are read as QJsonObject whether they're tagged or not
+            case QMetaType::QJsonObject:
+            case QMetaType::UnknownType:
+                return decodeGeneric;
+
+            default:
+                break;
+        }
+        return decodeTagged;
+    }
+
+    bool fromJsonObject(const QJsonObject &obj, QSettings::SettingsMap &settings,
+                        const QJsonSettingsSchema *schema) {
+        QVariantMap result;
+        if (!Reader(obj, activeSchema(schema)).toVariantMap(result)) {
+            return false;
+        }
+        settings = std::move(result);
+        return true;
+    }
+
+    bool fromJsonGroups(const QJsonObject &obj, QSettings::SettingsMap &settings,
+                        const QJsonSettingsSchema *schema, const QStringList &groups,
+                        GroupFilter filter) {
+        QVariantMap result = settings;
+        if (!Reader(obj, activeSchema(schema), &groups, filter).toVariantMap(result)) {
+            return false;
+        }
+        settings = std::move(result);
+        return true;
+    }
+
+    bool toJsonObject(const QSettings::SettingsMap &settings, QJsonObject &obj) {
+        return Writer(settings).toJsonObject(obj);
+    }
+
+    bool fromJson(const QByteArray &data, QSettings::SettingsMap &settings,
+                  const QJsonSettingsSchema *schema) {
+        QJsonObject obj;
+        if (!parseJson(data, obj)) {
+            return false;
+        }
+        if (!fromJsonObject(obj, settings, schema)) {
+            setLastError(QJsonSettings::Error::InvalidContent);
+            return false;
+        }
+        return true;
+    }
+
+    bool strictEquals(const QVariant &a, const QVariant &b) {
+        if (a.userType() != b.userType()) {
+            return false;
+        }
+        switch (a.userType()) {
+            case QMetaType::QVariantList: {
+                const auto &list1 = *static_cast<const QVariantList *>(a.constData());
+                const auto &list2 = *static_cast<const QVariantList *>(b.constData());
+                return std::equal(list1.begin(), list1.end(), list2.begin(), list2.end(),
+                                  strictEquals);
+            }
+            case QMetaType::QVariantMap: {
+                const auto &map1 = *static_cast<const QVariantMap *>(a.constData());
+                const auto &map2 = *static_cast<const QVariantMap *>(b.constData());
+                if (map1.size() != map2.size()) {
+                    return false;
+                }
+                for (auto it1 = map1.begin(), it2 = map2.begin(); it1 != map1.end(); ++it1, ++it2) {
+                    if (it1.key() != it2.key() || !strictEquals(it1.value(), it2.value())) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            case QMetaType::QVariantHash: {
+                const auto &hash1 = *static_cast<const QVariantHash *>(a.constData());
+                const auto &hash2 = *static_cast<const QVariantHash *>(b.constData());
+                if (hash1.size() != hash2.size()) {
+                    return false;
+                }
+                for (auto it1 = hash1.begin(); it1 != hash1.end(); ++it1) {
+                    auto it2 = hash2.constFind(it1.key());
+                    if (it2 == hash2.constEnd() || !strictEquals(it1.value(), it2.value())) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            default:
+                break;
+        }
+        return a == b;
+    }
+
+    bool findJsonValue(const QJsonObject &root, QStringView key, QJsonValue &value, int *depth) {
+        SettingsKeys keys;
+        splitSettingsPath(keys, key);
+        if (keys.isEmpty()) {
+            return false;
+        }
+
+        QJsonObject group = root;
+        for (qsizetype i = 0; i < keys.size() - 1; ++i) {
+            const QJsonValue child = jsonMember(group, keys[i]);
+            if (!isBranchValue(child)) {
+                return false;
+            }
+            group = child.toObject();
+        }
+
+        value = jsonMember(group, keys.back());
+        if (isBranchValue(value)) {
+            value = value.toObject().value(kKeyValue);
+        }
+        if (depth) {
+            *depth = int(keys.size() - 1);
+        }
+        return !value.isUndefined();
+    }
+
+    bool resolveJsonReference(const QJsonObject &root, QJsonValue &value, int *depth) {
+        const QString target = value[kKeyValueRef].toString();
+        return findJsonValue(root, target, value, depth) && !isReferenceValue(value);
+    }
+
+    bool toJson(const QSettings::SettingsMap &settings, QByteArray &data, QJsonObject *obj) {
+        const Writer writer(settings);
+        QJsonObject result;
+        if (!writer.toJsonObject(result)) {
+            return false;
+        }
+        data = writeJson(result, writer.leafCount(), writer.branchCount());
+        if (obj) {
+            *obj = std::move(result);
+        }
+        return true;
+    }
+
+    void reportSizeEstimate(QJsonSettings::SizeEstimate::Buffer buffer, qsizetype estimated,
+                            qsizetype actual) {
+        if (auto handler = sizeEstimateCallback.load(std::memory_order_relaxed)) {
+            handler({buffer, estimated, actual});
+        }
+    }
+
+    inline char hexDigit(uint value) {
+        return char(value < 10 ? '0' + value : 'a' + value - 10);
+    }
+
+    void appendJsonString(QByteArray &out, QStringView str) {
+        out.append('"');
+        for (qsizetype i = 0; i < str.size(); ++i) {
+            const uint u = str[i].unicode();
+            if (u < 0x80) {
+                if (u >= 0x20 && u != '"' && u != '\\') {
+                    out.append(char(u));
+                    continue;
+                }
+                out.append('\\');
+                switch (u) {
+                    case '"':
+                        out.append('"');
+                        break;
+                    case '\\':
+                        out.append('\\');
+                        break;
+                    case '\b':
+                        out.append('b');
+                        break;
+                    case '\f':
+                        out.append('f');
+                        break;
+                    case '\n':
+                        out.append('n');
+                        break;
+                    case '\r':
+                        out.append('r');
+                        break;
+                    case '\t':
+                        out.append('t');
+                        break;
+                    default:
+                        out.append("u00", 3);
+                        out.append(hexDigit(u >> 4));
+                        out.append(hexDigit(u & 0xf));
+                        break;
+                }
+            } else if (u < 0x800) {
+                out.append(char(0xc0 | (u >> 6)));
+                out.append(char(0x80 | (u & 0x3f)));
+            } else if (!QChar::isSurrogate(u)) {
+                out.append(char(0xe0 | (u >> 12)));
+                out.append(char(0x80 | ((u >> 6) & 0x3f)));
+                out.append(char(0x80 | (u & 0x3f)));
+            } else if (QChar::isHighSurrogate(u) && i + 1 < str.size() &&
+                       QChar::isLowSurrogate(str[i + 1].unicode())) {
+                const uint ucs4 = QChar::surrogateToUcs4(char16_t(u), str[++i].unicode());
+                out.append(char(0xf0 | (ucs4 >> 18)));
+                out.append(char(0x80 | ((ucs4 >> 12) & 0x3f)));
+                out.append(char(0x80 | ((ucs4 >> 6) & 0x3f)));
+                out.append(char(0x80 | (ucs4 & 0x3f)));
+            } else {
+                // Unpaired surrogates have no UTF-8 form and are escaped
+                out.append("\\u", 2);
+                out.append(hexDigit(u >> 12));
+                out.append(hexDigit((u >> 8) & 0xf));
+                out.append(hexDigit((u >> 4) & 0xf));
+                out.append(hexDigit(u & 0xf));
+            }
+        }
+        out.append('"');
+    }
+
+    void appendJsonScalar(QByteArray &out, const QJsonValue &value) {
+        switch (value.type()) {
+            case QJsonValue::Bool:
+                out.append(value.toBool() ? "true" : "false");
+                break;
+            case QJsonValue::Double: {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+                // Integers are kept apart from doubles since Qt 6
+                const QVariant variant = value.toVariant();
+                if (variant.userType() == QMetaType::LongLong) {
+                    out.append(QByteArray::number(variant.toLongLong()));
+                    break;
+                }
+#endif
+                const double d = value.toDouble();
+                if (std::isfinite(d)) {
+                    out.append(QByteArray::number(d, 'g', QLocale::FloatingPointShortest));
+                } else {
+                    out.append("null");
+                }
+                break;
+            }
+            case QJsonValue::String:
+                appendJsonString(out, value.toString());
+                break;
+            default:
+                out.append("null");
+                break;
+        }
+    }
+
+    // Same layout as QJsonDocument::toJson(QJsonDocument::Indented), walked with an explicit
+    // stack so that deep values can't overflow the call stack
+    void appendJson(QByteArray &out, const QJsonObject &root) {
+        struct Frame {
+            QJsonObject obj;
+            QJsonArray arr;
+            qsizetype index;
+            bool isArray;
+        };
+
+        QVarLengthArray<Frame, 32> stack;
+        out.append("{\n", 2);
+        stack.append({root, {}, 0, false});
+        while (!stack.isEmpty()) {
+            auto &frame = stack.last();
+            const int indent = int(stack.size());
+            const qsizetype size = frame.isArray ? frame.arr.size() : frame.obj.size();
+            if (frame.index == size) {
+                const bool isArray = frame.isArray;
+                stack.removeLast();
+                if (size > 0) {
+                    out.append('\n');
+                }
+                out.append(4 * (indent - 1), ' ');
+                out.append(isArray ? ']' : '}');
+                continue;
+            }
+
+            // NOTE: copy the entry, "frame" is invalidated when a child is pushed
+            const qsizetype index = frame.index++;
+            if (index > 0) {
+                out.append(",\n", 2);
+            }
+            out.append(4 * indent, ' ');
+            QJsonValue value;
+            if (frame.isArray) {
+                value = frame.arr.at(index);
+            } else {
+                const auto it = frame.obj.constBegin() + index;
+                appendJsonString(out, it.key());
+                out.append(": ", 2);
+                value = it.value();
+            }
+            if (value.isObject()) {
+                out.append("{\n", 2);
+                stack.append({value.toObject(), {}, 0, false});
+            } else if (value.isArray()) {
+                out.append("[\n", 2);
+                stack.append({{}, value.toArray(), 0, true});
+            } else {
+                appendJsonScalar(out, value);
+            }
+        }
+    }
+
+    QByteArray writeJson(const QJsonObject &obj, qsizetype leafCount, qsizetype branchCount) {
+        // Serialized directly instead of through QJsonDocument, which grows a buffer of its own
+        const qsizetype estimated = leafCount * averageLeafBytes.load(std::memory_order_relaxed);
+        QByteArray data;
+        data.reserve(estimated + 3);
+        appendJson(data, obj);
+        data.append('\n');
+        reportSizeEstimate(QJsonSettings::SizeEstimate::OutputData, estimated, data.size());
+        updateAverages(data.size(), leafCount, branchCount);
+        return data;
+    }
+
+}
+
+// SCHEMA
+QJsonSettingsSchema::QJsonSettingsSchema() : d(new QJsonSettingsSchemaData()) {
+}
+
+QJsonSettingsSchema::QJsonSettingsSchema(std::initializer_list<std::pair<QString, int>> types)
+    : QJsonSettingsSchema() {
+    for (const auto &pair : types) {
+        insert(pair.first, pair.second);
+    }
+}
+
+QJsonSettingsSchema::QJsonSettingsSchema(const QJsonSettingsSchema &other) = default;
+
+QJsonSettingsSchema &QJsonSettingsSchema::operator=(const QJsonSettingsSchema &other) = default;
+
+QJsonSettingsSchema::~QJsonSettingsSchema() = default;
+
+void QJsonSettingsSchema::insert(const QString &key, int type) {
+    d->entries.insert(key, {type, QJsonSettingsPrivate::decoderForType(type)});
+}
+
+void QJsonSettingsSchema::remove(const QString &key) {
+    d->entries.remove(key);
+}
+
+bool QJsonSettingsSchema::isEmpty() const {
+    return d->entries.isEmpty();
+}
+
+bool QJsonSettingsSchema::contains(const QString &key) const {
+    return d->entries.contains(key);
+}
+
+int QJsonSettingsSchema::type(const QString &key) const {
+    auto it = d->entries.constFind(key);
+    return it == d->entries.constEnd() ? int(QMetaType::UnknownType) : it->type;
+}
+
+QJsonSettingsSchema::UnknownKeyPolicy QJsonSettingsSchema::unknownKeyPolicy() const {
+    return d->unknownKeyPolicy;
+}
+
+void QJsonSettingsSchema::setUnknownKeyPolicy(UnknownKeyPolicy policy) {
+    d->unknownKeyPolicy = policy;
+}
+
 // INTERFACES
+namespace {
+
+    struct GlobalSchema {
+        QMutex mutex;
+        QJsonSettingsSchema schema;
+    };
+
+    static GlobalSchema &globalSchema() {
+        static GlobalSchema instance;
+        return instance;
+    }
+
+}
+
 QString QJsonSettings::reservedKey(ReservedKey key) {
     switch (key) {
         case ReservedKey::Value:
@@ -954,23 +2658,129 @@ QString QJsonSettings::reservedKey(ReservedKey key) {
             return kKeyValueType;
         case ValueData:
             return kKeyValueData;
+        case ValueRef:
+            return kKeyValueRef;
+        case CompactValueType:
+            return kKeyCompactValueType;
+        case CompactValueData:
+            return kKeyCompactValueData;
     };
     return {};
 }
 
+int QJsonSettings::maxDepth() {
+    return maxNestingDepth.load(std::memory_order_relaxed);
+}
+
+void QJsonSettings::setMaxDepth(int depth) {
+    maxNestingDepth.store(depth, std::memory_order_relaxed);
+}
+
+void QJsonSettings::setStringInterning(bool enabled) {
+    stringInterningEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool QJsonSettings::stringInterning() {
+    return stringInterningEnabled.load(std::memory_order_relaxed);
+}
+
+void QJsonSettings::clearInternedStrings() {
+    stringPool().clear();
+}
+
+void QJsonSettings::setValueReferences(bool enabled) {
+    valueReferencesEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool QJsonSettings::valueReferences() {
+    return valueReferencesEnabled.load(std::memory_order_relaxed);
+}
+
+void QJsonSettings::setCompactTags(bool enabled) {
+    compactTagsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool QJsonSettings::compactTags() {
+    return compactTagsEnabled.load(std::memory_order_relaxed);
+}
+
+void QJsonSettings::setSnapshots(bool enabled) {
+    snapshotsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool QJsonSettings::snapshots() {
+    return snapshotsEnabled.load(std::memory_order_relaxed);
+}
+
+void QJsonSettings::setIncrementalWrites(bool enabled) {
+    incrementalWritesEnabled.store(enabled, std::memory_order_relaxed);
+    if (!enabled) {
+        QJsonSettingsPrivate::clearWrittenFiles();
+    }
+}
+
+bool QJsonSettings::incrementalWrites() {
+    return incrementalWritesEnabled.load(std::memory_order_relaxed);
+}
+
+void QJsonSettings::setSizeEstimateHandler(SizeEstimateHandler handler) {
+    sizeEstimateCallback.store(handler, std::memory_order_relaxed);
+}
+
+QJsonSettings::SizeEstimateHandler QJsonSettings::sizeEstimateHandler() {
+    return sizeEstimateCallback.load(std::memory_order_relaxed);
+}
+
+QJsonSettingsSchema QJsonSettings::schema() {
+    auto &global = globalSchema();
+    QMutexLocker locker(&global.mutex);
+    return global.schema;
+}
+
+void QJsonSettings::setSchema(const QJsonSettingsSchema &schema) {
+    auto &global = globalSchema();
+    QMutexLocker locker(&global.mutex);
+    global.schema = schema;
+}
+
 bool QJsonSettings::read(QIODevice &dev, QSettings::SettingsMap &settings) {
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(dev.readAll(), &error);
-    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+    return read(dev, settings, schema());
+}
+
+bool QJsonSettings::read(QIODevice &dev, QSettings::SettingsMap &settings,
+                         const QJsonSettingsSchema &schema) {
+    const auto file = qobject_cast<QFileDevice *>(&dev);
+    QByteArray data;
+    if (!QJsonSettingsPrivate::readJson(dev, data)) {
         return false;
     }
-    settings = Reader(doc.object()).toVariantMap();
-    return true;
+    if (file && QJsonSettingsPrivate::takeWarmed(file->fileName(), data, settings, schema)) {
+        return true;
+    }
+    if (file && snapshotsEnabled.load(std::memory_order_relaxed) &&
+        QJsonSettingsPrivate::readSnapshot(file->fileName(), data, settings, &schema)) {
+        return true;
+    }
+    return QJsonSettingsPrivate::fromJson(data, settings, &schema);
 }
 
 bool QJsonSettings::write(QIODevice &dev, const QSettings::SettingsMap &settings) {
-    QJsonDocument doc;
-    doc.setObject(Writer(settings).toJsonObject());
-    dev.write(doc.toJson());
+    // QSettings writes through a QSaveFile, which still reports the name of the target file
+    const auto file = qobject_cast<QFileDevice *>(&dev);
+
+    QByteArray data;
+    QJsonObject obj;
+    if (file && incrementalWritesEnabled.load(std::memory_order_relaxed)) {
+        if (!QJsonSettingsPrivate::toJsonIncremental(file->fileName(), settings, data, &obj)) {
+            return false;
+        }
+    } else if (!QJsonSettingsPrivate::toJson(settings, data, &obj)) {
+        return false;
+    }
+    dev.write(data);
+
+    if (file && snapshotsEnabled.load(std::memory_order_relaxed)) {
+        QJsonSettingsPrivate::writeSnapshot(file->fileName(), data, obj, settings);
+    }
     return true;
 }
\ No newline at end of file
@@ -4,7 +4,50 @@
 #ifndef QJSONSETTINGS_H
 #define QJSONSETTINGS_H
 
+#include <utility>
+#include <initializer_list>
+
 #include <QtCore/QSettings>
+#include <QtCore/QSharedDataPointer>
+#include <QtCore/QFuture>
+
+class QJsonSettingsSchemaData;
+
+// Known key paths and their meta types. Values of known keys are converted directly by a
+// converter selected in advance, instead of looking up and dispatching on their "$type".
+class QJsonSettingsSchema {
+public:
+    enum UnknownKeyPolicy {
+        DecodeUnknownKeys,
+        SkipUnknownKeys,
+        RejectUnknownKeys,
+    };
+
+    QJsonSettingsSchema();
+    QJsonSettingsSchema(std::initializer_list<std::pair<QString, int>> types);
+    QJsonSettingsSchema(const QJsonSettingsSchema &other);
+    QJsonSettingsSchema &operator=(const QJsonSettingsSchema &other);
+    ~QJsonSettingsSchema();
+
+    void insert(const QString &key, int type);
+    template <class T>
+    inline void insert(const QString &key) {
+        insert(key, qMetaTypeId<T>());
+    }
+    void remove(const QString &key);
+
+    bool isEmpty() const;
+    bool contains(const QString &key) const;
+    int type(const QString &key) const;
+
+    UnknownKeyPolicy unknownKeyPolicy() const;
+    void setUnknownKeyPolicy(UnknownKeyPolicy policy);
+
+private:
+    QSharedDataPointer<QJsonSettingsSchemaData> d;
+
+    friend class QJsonSettingsSchemaData;
+};
 
 class QJsonSettings {
 public:
@@ -15,12 +58,143 @@ public:
         Value,
         ValueType,
         ValueData,
+        ValueRef,
+        CompactValueType,
+        CompactValueData,
     };
     static QString reservedKey(ReservedKey key);
 
+    // Maximum nesting depth of groups and container values, reading or writing deeper settings
+    // fails instead of exhausting the stack, 1024 by default
+    static int maxDepth();
+    static void setMaxDepth(int depth);
+
+    // Limits on the settings files read, zero means unlimited which is the default. The file size
+    // is checked before the file is read and the other limits while it's read, so reading stops
+    // at the first violation instead of after parsing. String lengths are in bytes, elements are
+    // counted per array or object, and containers are nested at most maxDepth deep.
+    struct Limits {
+        qint64 maxFileSize = 0;
+        qint64 maxKeys = 0;
+        qint64 maxStringLength = 0;
+        qint64 maxElements = 0;
+    };
+    static Limits limits();
+    static void setLimits(const Limits &limits);
+
+    // Why the last read on the calling thread failed, with the byte offset in the file where the
+    // failure was detected if it's known
+    struct Error {
+        enum Reason {
+            NoError,
+            ReadError,
+            FileTooLarge,
+            TooDeep,
+            TooManyKeys,
+            StringTooLong,
+            TooManyElements,
+            SyntaxError,
+            InvalidContent,
+        };
+        Reason reason = NoError;
+        qint64 offset = -1;
+    };
+    static Error lastError();
+
+    // Share recurring key paths and short string values between reads through a global intern
+    // table, disabled by default. The table keeps up to 16384 strings and drops the ones that
+    // weren't met by the recent reads first. Dropped strings stay shared by the settings already
+    // read, they're only no longer shared with the next reads.
+    static void setStringInterning(bool enabled);
+    static bool stringInterning();
+    static void clearInternedStrings();
+
+    // Write a repeated large value as {"$ref": "a/b/c"} naming the key of its first occurrence in
+    // the same top-level group, disabled by default. References are always expanded on read, user
+    // keys named "$ref" are escaped so they aren't read as one.
+    static void setValueReferences(bool enabled);
+    static bool valueReferences();
+
+    // Write tagged values as {"$t": ..., "$d": ...} instead of {"$type": ..., "$data": ...},
+    // disabled by default. Both forms are always read.
+    static void setCompactTags(bool enabled);
+    static bool compactTags();
+
+    // Write a binary snapshot of the decoded settings next to each settings file, and read it
+    // instead of converting the file while the file's content is unchanged, disabled by default.
+    // Snapshots are skipped for reads with a schema and for values without stream operators.
+    static void setSnapshots(bool enabled);
+    static bool snapshots();
+
+    // Keep the settings and the converted tree of the last write of each file, so that the next
+    // write of the file only converts the keys that changed since instead of the whole map, and
+    // reuses the encodings of the others. Costs a copy of the settings for each of the 8 most
+    // recently written files, which disabling drops. Disabled by default.
+    static void setIncrementalWrites(bool enabled);
+    static bool incrementalWrites();
+
+    // Buffer size estimated before reading or writing, reported with the size the buffer ended up
+    // with. Estimates that keep falling short mean the buffer still grows while it's filled.
+    struct SizeEstimate {
+        enum Buffer {
+            InputData,
+            OutputData,
+            LeafNodes,
+            BranchNodes,
+        };
+        Buffer buffer;
+        qsizetype estimated;
+        qsizetype actual;
+    };
+    using SizeEstimateHandler = void (*)(const SizeEstimate &estimate);
+
+    // Called on the thread that reads or writes, none by default
+    static void setSizeEstimateHandler(SizeEstimateHandler handler);
+    static SizeEstimateHandler sizeEstimateHandler();
+
+    // Schema used when reading through the registered format, empty by default
+    static QJsonSettingsSchema schema();
+    static void setSchema(const QJsonSettingsSchema &schema);
+
     static bool read(QIODevice &dev, QSettings::SettingsMap &settings);
+    static bool read(QIODevice &dev, QSettings::SettingsMap &settings,
+                     const QJsonSettingsSchema &schema);
     static bool write(QIODevice &dev, const QSettings::SettingsMap &settings);
 
+    // Settings read on another thread, the settings are empty and the error says why if the read
+    // failed
+    struct ReadResult {
+        QSettings::SettingsMap settings;
+        Error error;
+    };
+
+    // Reads and converts the file on the global thread pool with the global schema. A canceled
+    // read finishes without a result.
+    static QFuture<ReadResult> readAsync(const QString &path);
+
+    // Converts and writes the file on the global thread pool. The file is left untouched if the
+    // write fails or is canceled.
+    static QFuture<bool> writeAsync(const QString &path, const QSettings::SettingsMap &settings);
+
+    // Reads the file on the global thread pool ahead of time, asking the system to bring its
+    // pages into memory, and converts the groups under the given prefixes with the global schema,
+    // the whole file if there are none. The next read of the file with the same content only
+    // converts what's left instead of parsing it again. Entries that aren't read are dropped after
+    // a few minutes or when too many files are warm. Finishes with false if the file can't be
+    // read.
+    static QFuture<bool> warm(const QString &path, const QStringList &prefixes = {});
+
+    // Flat JSON Lines form with one {"key": "a/b/c", "value": ...} record per line, values are
+    // encoded the same way as in settings files. Records are converted one at a time, so the
+    // output of an export is never held in memory.
+    static bool exportJsonLines(QIODevice &dev, const QSettings::SettingsMap &settings);
+    static bool importJsonLines(QIODevice &dev, QSettings::SettingsMap &settings);
+
+    // Converts between a settings file and the JSON Lines form, the values are copied as they are
+    // encoded without being decoded
+    static bool exportJsonLines(QIODevice &dev, QIODevice &json);
+    static bool importJsonLines(QIODevice &dev, QIODevice &json);
+
     static inline QSettings::Format registerFormat() {
         return QSettings::registerFormat(QStringLiteral("json"), read, write, Qt::CaseSensitive);
     }
@@ -0,0 +1,599 @@
+// Copyright (C) 2025 Stdware Collections (https://www.github.com/stdware)
+// SPDX-License-Identifier: MIT
+
+#ifndef QJSONSETTINGS_P_H
+#define QJSONSETTINGS_P_H
+
+//
+//  W A R N I N G !!!
+//  -----------------
+//
+// This file is not part of the QJsonSettings API. It is used purely as an
+// implementation detail. This header file may change from version to
+// version without notice, or may even be removed.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QSharedData>
+#include <QtCore/QStringList>
+#include <QtCore/QVariant>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QVector>
+#include <QtCore/QJsonValue>
+#include <QtCore/QJsonObject>
+
+#include "qjsonsettings.h"
+
+namespace QJsonSettingsPrivate {
+
+    inline const QString kKeyValue = QStringLiteral("$value");
+
+    inline const QString kKeyValueType = QStringLiteral("$type");
+
+    inline const QString kKeyValueData = QStringLiteral("$data");
+
+    inline const QString kKeyValueRef = QStringLiteral("$ref");
+
+    inline const QString kKeyCompactValueType = QStringLiteral("$t");
+
+    inline const QString kKeyCompactValueData = QStringLiteral("$d");
+
+    inline constexpr QLatin1Char kSeparator = QLatin1Char('/');
+
+    // Qt 5.15 lacks a few Qt 6 APIs, these helpers use the Qt 6 API where it's available
+
+    inline qsizetype countSeparators(QStringView s) {
+        return std::count(s.begin(), s.end(), QChar(kSeparator));
+    }
+
+    // Same as qHashMulti(seed, value) in Qt 6, the hashes are never persisted
+    template <class T>
+    inline size_t hashCombine(size_t seed, const T &value) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        return qHashMulti(seed, value);
+#else
+        return seed ^ (size_t(qHash(value)) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+#endif
+    }
+
+    inline bool convertVariant(QVariant &value, int type) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        return value.convert(QMetaType(type));
+#else
+        return value.convert(type);
+#endif
+    }
+
+    // Maximum nesting depth of groups and containers, matches the nesting limit of the Qt JSON
+    // parser by default
+    inline std::atomic<int> maxNestingDepth{1024};
+
+    QVariant jsonValueToVariant(const QJsonValue &value, int depth, bool &ok);
+
+    QJsonValue variantToJsonValue(const QVariant &value, int depth, bool &ok);
+
+    void reportSizeEstimate(QJsonSettings::SizeEstimate::Buffer buffer, qsizetype estimated,
+                            qsizetype actual);
+
+    // Reads the rest of the device within the configured limits, reading stops at the first
+    // violation which is recorded as the last error. A random access device is read into a
+    // buffer of its size. The progress is called with the number of bytes read after each chunk,
+    // reading stops without an error if it returns false.
+    bool readJson(QIODevice &dev, QByteArray &data,
+                  const std::function<bool(qint64)> &progress = {});
+
+    // Parses a settings document, a syntax error is recorded as the last error
+    bool parseJson(const QByteArray &data, QJsonObject &obj);
+
+    void setLastError(QJsonSettings::Error::Reason reason, qint64 offset = -1);
+
+    // Checks the size and the structure of a JSON document against the configured limits chunk
+    // by chunk, without parsing it. Only tracks what the limits need, the syntax is left to the
+    // parser. Every reader of settings documents goes through it.
+    class JsonLimitScanner {
+    public:
+        JsonLimitScanner();
+
+        // Whether any limit needs the content to be scanned, the size is checked regardless
+        inline bool isActive() const {
+            return active;
+        }
+
+        inline qint64 maxFileSize() const {
+            return limits.maxFileSize;
+        }
+
+        // Checks the size of the document before it's read, -1 if it's unknown
+        bool checkSize(qint64 size) const;
+
+        // Returns false and records the last error at the first violation
+        bool feed(const char *data, qsizetype size);
+
+    private:
+        QJsonSettings::Limits limits;
+        int maxDepth;
+        bool active;
+
+        qint64 offset = 0;
+        qint64 keys = 0;
+        qint64 stringLength = 0;
+        bool inString = false;
+        bool escaped = false;
+
+        // Number of separators met in each open container
+        QVarLengthArray<qint64, 64> elements;
+    };
+
+    // Serializes a settings document of the given number of nodes, the running averages used to
+    // size the next documents are updated from the result
+    QByteArray writeJson(const QJsonObject &obj, qsizetype leafCount, qsizetype branchCount);
+
+    // Single pass iterator over the segments of a settings key, the segments are views into the
+    // key and the scan for separators is vectorized by QtCore
+    class SettingsKeyIterator {
+    public:
+        // Empty segments are dropped if "skipEmpty" is true, so "a//b/" addresses "a/b"
+        explicit SettingsKeyIterator(QStringView key, bool skipEmpty = false)
+            : key(key), skipEmpty(skipEmpty) {
+            advance();
+        }
+
+        inline bool hasNext() const {
+            return hasSegment;
+        }
+
+        inline QStringView next() {
+            const QStringView result = segment;
+            advance();
+            return result;
+        }
+
+    private:
+        void advance() {
+            while (pos <= key.size()) {
+                qsizetype end = key.indexOf(kSeparator, pos);
+                if (end < 0) {
+                    end = key.size();
+                }
+                segment = key.mid(pos, end - pos);
+                pos = end + 1;
+                if (!skipEmpty || !segment.isEmpty()) {
+                    hasSegment = true;
+                    return;
+                }
+            }
+            hasSegment = false;
+        }
+
+        QStringView key;
+        QStringView segment;
+        qsizetype pos = 0;
+        bool skipEmpty;
+        bool hasSegment = false;
+    };
+
+    // Keys deeper than the inline capacity spill to the heap
+    using SettingsKeys = QVarLengthArray<QStringView, 16>;
+
+    inline void splitSettingsKeys(SettingsKeys &result, QStringView s) {
+        for (SettingsKeyIterator it(s); it.hasNext();) {
+            result.append(it.next());
+        }
+    }
+
+    // Same as "splitSettingsKeys" but drops empty segments, so "a//b/" addresses "a/b"
+    inline void splitSettingsPath(SettingsKeys &result, QStringView s) {
+        for (SettingsKeyIterator it(s, true); it.hasNext();) {
+            result.append(it.next());
+        }
+    }
+
+    // Joins a group and a key with a single allocation, the group is reused by the caller for
+    // every key inside it
+    inline QString joinSettingsKey(QStringView group, QStringView key) {
+        if (group.isEmpty()) {
+            return key.toString();
+        }
+        QString result;
+        result.reserve(group.size() + 1 + key.size());
+        result.append(group.data(), group.size()).append(kSeparator).append(key.data(), key.size());
+        return result;
+    }
+
+    // Key with empty segments dropped, so that the same key is recorded once however it's spelled
+    inline QString normalizedKey(QStringView key) {
+        SettingsKeys keys;
+        splitSettingsPath(keys, key);
+        QString result;
+        for (const auto &segment : std::as_const(keys)) {
+            if (!result.isEmpty()) {
+                result.append(kSeparator);
+            }
+            result.append(segment.data(), segment.size());
+        }
+        return result;
+    }
+
+    // Size and modification time of a file, to tell whether it changed since it was read. A file
+    // that doesn't exist has a size of -1.
+    struct FileStamp {
+        qint64 size = -1;
+        QDateTime modified;
+
+        static FileStamp of(const QString &path) {
+            const QFileInfo info(path);
+            if (!info.exists()) {
+                return {};
+            }
+            return {info.size(), info.lastModified()};
+        }
+
+        inline bool operator==(const FileStamp &other) const {
+            return size == other.size && modified == other.modified;
+        }
+
+        inline bool operator!=(const FileStamp &other) const {
+            return !(*this == other);
+        }
+    };
+
+    // Whether the value refers to the value of another key, {"$ref": "a/b/c"}
+    inline bool isReferenceValue(const QJsonValue &value) {
+        if (!value.isObject()) {
+            return false;
+        }
+        const QJsonObject obj = value.toObject();
+        return obj.size() == 1 && obj.constBegin().key() == kKeyValueRef &&
+               obj.constBegin().value().isString();
+    }
+
+    // Whether the object is a tagged value, {"$type": ..., "$data": ...} or the compact form
+    // {"$t": ..., "$d": ...} which has to match exactly
+    inline bool isTaggedObject(const QJsonObject &obj) {
+        return obj.contains(kKeyValueType) ||
+               (obj.size() == 2 && obj.contains(kKeyCompactValueType) &&
+                obj.contains(kKeyCompactValueData));
+    }
+
+    // Whether a key segment is named like the key of a reference or of a compact tag, "$ref",
+    // "$t" or "$d" after any number of "$". Such a user key is written with one more "$" in
+    // front, so that a group holding it isn't read as a reference or a tagged value.
+    inline bool isEscapedName(QStringView key) {
+        qsizetype i = 0;
+        while (i < key.size() && key[i] == QLatin1Char('$')) {
+            ++i;
+        }
+        if (i == 0) {
+            return false;
+        }
+        const QStringView name = key.mid(i);
+        return name == QStringView(u"ref") || name == QStringView(u"t") ||
+               name == QStringView(u"d");
+    }
+
+    // Name of a key segment in JSON
+    inline QString escapeKey(const QString &key) {
+        return isEscapedName(key) ? QLatin1Char('$') + key : key;
+    }
+
+    // Key segment of a name in JSON, "$ref", "$t" and "$d" themselves are left as they are
+    inline QString unescapeKey(const QString &key) {
+        return key.startsWith(QLatin1String("$$")) && isEscapedName(key) ? key.mid(1) : key;
+    }
+
+    // Member of an object named by a key segment
+    inline QJsonValue jsonMember(const QJsonObject &obj, QStringView key) {
+        return isEscapedName(key) ? obj.value(QLatin1Char('$') + key.toString()) : obj.value(key);
+    }
+
+    // Whether the value is a group rather than a (tagged) value
+    inline bool isBranchValue(const QJsonValue &value) {
+        return value.isObject() && !isTaggedObject(value.toObject()) && !isReferenceValue(value);
+    }
+
+    // Equality without the numeric conversions of QVariant::operator==, values that compare equal
+    // here have the same encoding
+    bool strictEquals(const QVariant &a, const QVariant &b);
+
+    // Finds the JSON value of a key in a settings document, the value of a group is its "$value"
+    bool findJsonValue(const QJsonObject &root, QStringView key, QJsonValue &value,
+                       int *depth = nullptr);
+
+    // Resolves a reference to the JSON value it refers to, returns false if the target is missing
+    // or is a reference itself
+    bool resolveJsonReference(const QJsonObject &root, QJsonValue &value, int *depth = nullptr);
+
+    // Settings tree of branches (groups) and leafs (values), children are kept sorted by key
+    class Writer {
+    private:
+        // Tagged 32-bit reference, the top bit tells leafs from branches
+        struct NodeRef {
+            quint32 bits;
+
+            NodeRef(int index = 0, bool isLeaf = false)
+                : bits(quint32(index) | (isLeaf ? kLeafBit : 0)) {
+            }
+
+            inline int index() const {
+                return int(bits & ~kLeafBit);
+            }
+
+            inline bool isLeaf() const {
+                return bits & kLeafBit;
+            }
+
+            static constexpr quint32 kLeafBit = 0x80000000u;
+        };
+
+        struct LeafNode {
+            QString key;
+
+            // Also the decoded value of a loaded leaf once it's read
+            mutable QVariant value;
+
+            // Value of a loaded leaf, decoded when it's first read and written back as it is until
+            // the leaf is assigned. Also the kept encoding of an assigned value, see
+            // "setKeepEncodings".
+            mutable QJsonValue encoded = QJsonValue(QJsonValue::Undefined);
+            mutable int depth = 0;
+
+            LeafNode(QString key = {}, QVariant value = {})
+                : key(std::move(key)), value(std::move(value)){};
+
+            inline bool isEncoded() const {
+                return !encoded.isUndefined();
+            }
+        };
+
+        // Most groups are small, larger ones spill to the heap
+        using NodeRefList = QVarLengthArray<NodeRef, 8>;
+        using KeyPrefixList = QVarLengthArray<quint64, 8>;
+
+        struct BranchNode {
+            QString key;
+
+            // Sorted by key, except in indexed branches where new children are appended and the
+            // sorting is deferred until the branch is listed
+            mutable NodeRefList refs;
+
+            // Leading characters of the children's keys packed in the same order as the keys, so
+            // the binary search reads a contiguous array and only compares keys on ties. Only kept
+            // for branches without a hash index.
+            KeyPrefixList prefixes;
+
+            // Positions of the children of wide branches, the keys view the children's keys
+            mutable QHash<QStringView, qsizetype> hashIndex;
+            mutable bool sorted = true;
+
+            BranchNode(QString key = {}) : key(std::move(key)){};
+        };
+
+        // Branches with this many children get a hash index, so that building a wide branch
+        // doesn't shift the children on every insertion
+        static constexpr qsizetype kIndexedBranchSize = 64;
+
+        // Emulated heap. Only the references and key prefixes are compact: keys are still held by
+        // each node's QString and children by each branch's own list, not in shared contiguous
+        // storage, since the tree is edited in place.
+        QVector<LeafNode> leafs;
+        QVector<BranchNode> branches;
+
+        // Root node index in the emulated heap, normally = 0
+        int rootIndex;
+
+        // Number of nodes detached by "remove" that still occupy the heap
+        int garbage = 0;
+
+        bool keepEncodings = false;
+
+        inline auto allocLeaf(QStringView key, const QVariant &value) {
+            int index = int(leafs.size());
+            leafs.emplace_back(key.toString(), value);
+            return index;
+        }
+
+        inline auto allocBranch(QStringView key) {
+            int index = int(branches.size());
+            branches.emplace_back(key.toString());
+            return index;
+        }
+
+        // The first four UTF-16 units of the key, zero padded, compare like the keys when they
+        // differ
+        static inline quint64 keyPrefix(QStringView key) {
+            quint64 prefix = 0;
+            for (qsizetype i = 0; i < 4; ++i) {
+                prefix = (prefix << 16) | (i < key.size() ? key[i].unicode() : 0);
+            }
+            return prefix;
+        }
+
+        inline const QString &keyOf(const NodeRef &ref) const {
+            return ref.isLeaf() ? leafs[ref.index()].key : branches[ref.index()].key;
+        }
+
+        void construct(const QVariantMap &input, int branchIndex);
+        void insertPath(int branchIndex, QStringView mergedKeys, const QVariant &value);
+        int findOrCreateBranch(QStringView key, int branchIndex);
+        void insert(int branchIndex, QStringView key, const QVariant &value);
+        int leafOf(int branchIndex, QStringView key);
+        QVariant leafValue(const LeafNode &leaf) const;
+        const LeafNode *findLeaf(QStringView key) const;
+        qsizetype indexOf(const BranchNode &branch, QStringView key, bool *keyExists) const;
+        void insertRef(BranchNode &branch, qsizetype pos, const NodeRef &ref);
+        void replaceRef(BranchNode &branch, qsizetype pos, const NodeRef &ref);
+        void removeRef(BranchNode &branch, qsizetype pos);
+        const NodeRefList &sortedRefs(const BranchNode &branch) const;
+        int findBranch(const SettingsKeys &keys, qsizetype count) const;
+        void removePath(const SettingsKeys &keys, bool valueOnly);
+        int countNodes(const NodeRef &ref) const;
+        void compact();
+        void reserveChildren(BranchNode &branch, qsizetype count);
+
+        // Pending branch of the explicit traversal stack, the object is inserted into its parent
+        // once all children are converted
+        struct JsonFrame {
+            const NodeRefList *refs;
+            qsizetype index;
+            QString key;
+            QJsonObject obj;
+            qsizetype groupSize;
+        };
+
+        struct MapFrame {
+            const NodeRefList *refs;
+            qsizetype index;
+            qsizetype groupSize;
+        };
+
+        struct LoadFrame {
+            QJsonObject obj;
+            qsizetype index;
+            int branchIndex;
+        };
+
+        // Reference met while loading, resolved once the whole document is loaded
+        struct PendingReference {
+            int branchIndex;
+            QString key;
+            QJsonValue value;
+            int depth;
+        };
+
+        bool toJsonObjectImpl(QJsonObject &result) const;
+        void toVariantMapImpl(QVariantMap &result) const;
+
+    public:
+        Writer();
+        explicit Writer(const QVariantMap &input);
+
+        // Replaces the tree with a settings document, returns false if it's nested deeper than
+        // the limit. The node pools are reserved up front if the size of the file is given.
+        bool load(const QJsonObject &input, qsizetype fileSize = 0);
+
+        QVariantMap toVariantMap() const;
+
+        // Returns false if the tree or a container value is nested deeper than the limit
+        bool toJsonObject(QJsonObject &result) const;
+
+        // Inserts a flat settings entry, the key is split the same way as the input map's keys
+        void insertPath(QStringView key, const QVariant &value);
+
+        // Path based access, empty segments of the path are ignored like QSettings does
+        bool find(QStringView key, QVariant *value = nullptr) const;
+        void setValue(QStringView key, const QVariant &value);
+        void remove(QStringView key);
+
+        // Removes the value of the key but not its subkeys, a group left with only its value
+        // becomes a plain value again like in a tree built from the remaining keys
+        void removeValue(QStringView key);
+        void clear();
+        bool isEmpty() const;
+        inline qsizetype leafCount() const {
+            return leafs.size();
+        }
+        inline qsizetype branchCount() const {
+            return branches.size();
+        }
+        QStringList childKeys(QStringView group) const;
+        QStringList childGroups(QStringView group) const;
+
+        // Keep the encodings made by the conversions to JSON, so that the next conversion only
+        // encodes the values assigned since. Has no effect while value references are enabled,
+        // the encoding of a value then depends on the values before it.
+        inline void setKeepEncodings(bool keep) {
+            keepEncodings = keep;
+        }
+    };
+
+    // Converts the JSON value of a key whose meta type is known in advance
+    using Decoder = QVariant (*)(const QJsonValue &value, int type, int depth, bool &ok);
+
+    Decoder decoderForType(int type);
+
+    // Converts a parsed settings document to flat settings, returns false if it's nested deeper
+    // than the limit or has a key rejected by the schema
+    bool fromJsonObject(const QJsonObject &obj, QSettings::SettingsMap &settings,
+                        const QJsonSettingsSchema *schema = nullptr);
+
+    // Converts flat settings to a settings document, returns false if it's nested deeper than the
+    // limit
+    bool toJsonObject(const QSettings::SettingsMap &settings, QJsonObject &obj);
+
+    enum GroupFilter {
+        OnlyGroups,
+        SkipGroups,
+    };
+
+    // Converts either only the given groups of a settings document or all but them, adding to
+    // the settings already converted. Converting only some groups fails on references, since
+    // their targets may be anywhere.
+    bool fromJsonGroups(const QJsonObject &obj, QSettings::SettingsMap &settings,
+                        const QJsonSettingsSchema *schema, const QStringList &groups,
+                        GroupFilter filter);
+
+    // Parses and converts a settings file
+    bool fromJson(const QByteArray &data, QSettings::SettingsMap &settings,
+                  const QJsonSettingsSchema *schema = nullptr);
+
+    // Converts and serializes flat settings, the converted document is returned as well if
+    // requested
+    bool toJson(const QSettings::SettingsMap &settings, QByteArray &data,
+                QJsonObject *obj = nullptr);
+
+    // 64-bit FNV-1a over whole words, stable across processes unlike the seeded qHash
+    quint64 hashBytes(const char *data, qsizetype size);
+
+    // Binary snapshot of the settings read from a file, stored as "<file>.snapshot" next to it
+    inline std::atomic<bool> snapshotsEnabled{false};
+
+    // Loads the snapshot of a file if it was taken from the given content, only for reads without
+    // a schema
+    bool readSnapshot(const QString &path, const QByteArray &json,
+                      QSettings::SettingsMap &settings, const QJsonSettingsSchema *schema);
+
+    // Takes the snapshot of a file being written, from the written content and document and the
+    // settings they were written for
+    void writeSnapshot(const QString &path, const QByteArray &json, const QJsonObject &obj,
+                       const QSettings::SettingsMap &written);
+
+    inline std::atomic<bool> incrementalWritesEnabled{false};
+
+    // Same as "toJson", but the tree of the last write of the file is updated with the changes
+    // since instead of being built again
+    bool toJsonIncremental(const QString &path, const QSettings::SettingsMap &settings,
+                           QByteArray &data, QJsonObject *obj = nullptr);
+
+    // Drops the kept trees of the last writes
+    void clearWrittenFiles();
+
+    // Takes the settings prepared by "QJsonSettings::warm" for a file, if they were prepared from
+    // the same content with the same schema
+    bool takeWarmed(const QString &path, const QByteArray &json, QSettings::SettingsMap &settings,
+                    const QJsonSettingsSchema &schema);
+
+}
+
+class QJsonSettingsSchemaData : public QSharedData {
+public:
+    struct Entry {
+        int type;
+        QJsonSettingsPrivate::Decoder decoder;
+    };
+
+    QHash<QString, Entry> entries;
+    QJsonSettingsSchema::UnknownKeyPolicy unknownKeyPolicy =
+        QJsonSettingsSchema::DecodeUnknownKeys;
+
+    static inline const QJsonSettingsSchemaData *get(const QJsonSettingsSchema &schema) {
+        return schema.d.constData();
+    }
+};
+
+#endif // QJSONSETTINGS_P_H
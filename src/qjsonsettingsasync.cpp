@@ -0,0 +1,142 @@
+#include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
+
+#include <limits>
+
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QFutureInterface>
+
+// UTILS
+namespace {
+
+    // Progress is reported in steps of this size, cancellation is checked between the chunks read
+    // or written
+    static constexpr qint64 kChunkSize = 1024 * 1024;
+
+    inline int chunkCount(qint64 size) {
+        return int(qMin<qint64>(size / kChunkSize + 1, std::numeric_limits<int>::max()));
+    }
+
+    class ReadTask : public QRunnable {
+    public:
+        explicit ReadTask(const QString &path) : path(path) {
+            promise.reportStarted();
+        }
+
+        void run() override {
+            QJsonSettings::ReadResult result;
+            if (!readImpl(result.settings)) {
+                result.settings.clear();
+                result.error = QJsonSettings::lastError();
+            }
+            // The error is recorded on this thread, so it's handed over with the result
+            if (!promise.isCanceled()) {
+                promise.reportResult(result);
+            }
+            promise.reportFinished();
+        }
+
+        QFutureInterface<QJsonSettings::ReadResult> promise;
+
+    private:
+        bool readImpl(QSettings::SettingsMap &settings) {
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly)) {
+                QJsonSettingsPrivate::setLastError(QJsonSettings::Error::ReadError);
+                return false;
+            }
+            promise.setProgressRange(0, chunkCount(file.size()));
+
+            QByteArray data;
+            const auto progress = [this](qint64 count) {
+                promise.setProgressValue(chunkCount(count) - 1);
+                return !promise.isCanceled();
+            };
+            if (!QJsonSettingsPrivate::readJson(file, data, progress) || promise.isCanceled()) {
+                return false;
+            }
+            promise.setProgressValue(promise.progressMaximum());
+
+            const auto &schema = QJsonSettings::schema();
+            if (QJsonSettingsPrivate::snapshotsEnabled.load(std::memory_order_relaxed) &&
+                QJsonSettingsPrivate::readSnapshot(path, data, settings, &schema)) {
+                return true;
+            }
+            return QJsonSettingsPrivate::fromJson(data, settings, &schema);
+        }
+
+        QString path;
+    };
+
+    class WriteTask : public QRunnable {
+    public:
+        WriteTask(const QString &path, const QSettings::SettingsMap &settings)
+            : path(path), settings(settings) {
+            promise.reportStarted();
+        }
+
+        void run() override {
+            promise.reportResult(writeImpl());
+            promise.reportFinished();
+        }
+
+        QFutureInterface<bool> promise;
+
+    private:
+        bool writeImpl() {
+            QByteArray data;
+            QJsonObject obj;
+            if (promise.isCanceled() || !QJsonSettingsPrivate::toJson(settings, data, &obj)) {
+                return false;
+            }
+
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly)) {
+                return false;
+            }
+            promise.setProgressRange(0, chunkCount(data.size()));
+
+            for (qint64 pos = 0, i = 0; pos < data.size(); pos += kChunkSize, ++i) {
+                if (promise.isCanceled()) {
+                    file.cancelWriting();
+                    return false;
+                }
+                const qint64 len = qMin<qint64>(kChunkSize, data.size() - pos);
+                if (file.write(data.constData() + pos, len) != len) {
+                    file.cancelWriting();
+                    return false;
+                }
+                promise.setProgressValue(int(i + 1));
+            }
+            if (!file.commit()) {
+                return false;
+            }
+            if (QJsonSettingsPrivate::snapshotsEnabled.load(std::memory_order_relaxed)) {
+                QJsonSettingsPrivate::writeSnapshot(path, data, obj, settings);
+            }
+            return true;
+        }
+
+        QString path;
+        QSettings::SettingsMap settings;
+    };
+
+}
+
+QFuture<QJsonSettings::ReadResult> QJsonSettings::readAsync(const QString &path) {
+    auto task = new ReadTask(path);
+    auto future = task->promise.future();
+    QThreadPool::globalInstance()->start(task);
+    return future;
+}
+
+QFuture<bool> QJsonSettings::writeAsync(const QString &path,
+                                        const QSettings::SettingsMap &settings) {
+    auto task = new WriteTask(path, settings);
+    auto future = task->promise.future();
+    QThreadPool::globalInstance()->start(task);
+    return future;
+}
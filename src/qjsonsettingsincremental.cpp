@@ -0,0 +1,139 @@
+#include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QMutex>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    // Files whose last write is kept, the least recently written one is dropped first
+    static constexpr qsizetype kMaxWrittenFiles = 8;
+
+    // Last write of a file, the tree keeps the encodings of its values
+    struct WrittenFile {
+        QSettings::SettingsMap settings;
+        Writer tree;
+        quint64 lastWrite = 0;
+
+        // Options the kept encodings were made with
+        bool compactTags = false;
+        int maxDepth = 0;
+
+        inline bool isCurrent() const {
+            return compactTags == QJsonSettings::compactTags() &&
+                   maxDepth == QJsonSettings::maxDepth();
+        }
+    };
+
+    struct WriteCache {
+        QMutex mutex;
+        QHash<QString, WrittenFile> files;
+        quint64 writes = 0;
+
+        // Keeps the file as the most recently written one, the caller holds the mutex
+        void insert(const QString &key, WrittenFile &&file) {
+            files.remove(key);
+            if (files.size() >= kMaxWrittenFiles) {
+                auto oldest = files.begin();
+                for (auto it = files.begin(); it != files.end(); ++it) {
+                    if (it->lastWrite < oldest->lastWrite) {
+                        oldest = it;
+                    }
+                }
+                files.erase(oldest);
+            }
+            file.lastWrite = ++writes;
+            files.insert(key, std::move(file));
+        }
+    };
+
+    static WriteCache &writeCache() {
+        static WriteCache cache;
+        return cache;
+    }
+
+    // Applies the differences between two versions of the settings to the tree of the first one,
+    // both maps are walked in key order side by side
+    void applyChanges(const QSettings::SettingsMap &from, const QSettings::SettingsMap &to,
+                      Writer &tree) {
+        if (from.isSharedWith(to)) {
+            return;
+        }
+
+        auto a = from.cbegin();
+        auto b = to.cbegin();
+        while (a != from.cend() || b != to.cend()) {
+            if (b == to.cend() || (a != from.cend() && a.key() < b.key())) {
+                tree.removeValue(a.key());
+                ++a;
+            } else if (a == from.cend() || b.key() < a.key()) {
+                tree.insertPath(b.key(), b.value());
+                ++b;
+            } else {
+                if (!strictEquals(a.value(), b.value())) {
+                    tree.insertPath(b.key(), b.value());
+                }
+                ++a;
+                ++b;
+            }
+        }
+    }
+
+}
+
+namespace QJsonSettingsPrivate {
+
+    bool toJsonIncremental(const QString &path, const QSettings::SettingsMap &settings,
+                           QByteArray &data, QJsonObject *obj) {
+        const QString key = QFileInfo(path).absoluteFilePath();
+
+        // Taken out of the cache while it's updated, a concurrent write of the same file builds
+        // its own tree
+        WrittenFile file;
+        bool found = false;
+        {
+            auto &cache = writeCache();
+            QMutexLocker locker(&cache.mutex);
+            auto it = cache.files.find(key);
+            if (it != cache.files.end()) {
+                file = std::move(it.value());
+                cache.files.erase(it);
+                found = true;
+            }
+        }
+
+        if (found && file.isCurrent()) {
+            applyChanges(file.settings, settings, file.tree);
+        } else {
+            file.tree = Writer(settings);
+            file.tree.setKeepEncodings(true);
+            file.compactTags = QJsonSettings::compactTags();
+            file.maxDepth = QJsonSettings::maxDepth();
+        }
+        file.settings = settings;
+
+        // A failed conversion may have kept some of the new encodings, so the tree is dropped
+        QJsonObject result;
+        if (!file.tree.toJsonObject(result)) {
+            return false;
+        }
+        data = writeJson(result, file.tree.leafCount(), file.tree.branchCount());
+        if (obj) {
+            *obj = std::move(result);
+        }
+
+        auto &cache = writeCache();
+        QMutexLocker locker(&cache.mutex);
+        cache.insert(key, std::move(file));
+        return true;
+    }
+
+    void clearWrittenFiles() {
+        auto &cache = writeCache();
+        QMutexLocker locker(&cache.mutex);
+        cache.files.clear();
+    }
+
+}
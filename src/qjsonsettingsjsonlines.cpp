@@ -0,0 +1,174 @@
+#include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QIODevice>
+#include <QtCore/QJsonDocument>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    static const QString kRecordKey = QStringLiteral("key");
+
+    static const QString kRecordValue = QStringLiteral("value");
+
+    bool writeRecord(QIODevice &dev, const QString &key, const QJsonValue &value) {
+        QJsonObject record;
+        record.insert(kRecordKey, key);
+        record.insert(kRecordValue, value);
+
+        QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+        line.append('\n');
+        return dev.write(line) == line.size();
+    }
+
+    // Reads the next record, returns false at the end of the device or if the record is invalid
+    bool readRecord(QIODevice &dev, QString &key, QJsonValue &value, bool &ok) {
+        while (!dev.atEnd()) {
+            const QByteArray line = dev.readLine().trimmed();
+            if (line.isEmpty()) {
+                continue;
+            }
+
+            QJsonParseError error;
+            const QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+            const QJsonObject record = doc.object();
+            const QJsonValue keyValue = record.value(kRecordKey);
+            value = record.value(kRecordValue);
+            if (error.error != QJsonParseError::NoError || !keyValue.isString() ||
+                value.isUndefined()) {
+                ok = false;
+                return false;
+            }
+            key = keyValue.toString();
+            return true;
+        }
+        return false;
+    }
+
+    // Nesting depth of the value of the key, as counted by the reader
+    inline int keyDepth(const QString &key) {
+        return int(key.count(kSeparator));
+    }
+
+}
+
+// INTERFACES
+bool QJsonSettings::exportJsonLines(QIODevice &dev, const QSettings::SettingsMap &settings) {
+    for (auto it = settings.begin(); it != settings.end(); ++it) {
+        bool ok = true;
+        const QJsonValue value = variantToJsonValue(it.value(), keyDepth(it.key()), ok);
+        if (!ok || !writeRecord(dev, it.key(), value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QJsonSettings::importJsonLines(QIODevice &dev, QSettings::SettingsMap &settings) {
+    QSettings::SettingsMap result;
+    QString key;
+    QJsonValue value;
+    bool ok = true;
+    while (readRecord(dev, key, value, ok)) {
+        QVariant variant = jsonValueToVariant(value, keyDepth(key), ok);
+        if (!ok) {
+            return false;
+        }
+        result.insert(key, std::move(variant));
+    }
+    if (!ok) {
+        return false;
+    }
+    settings = std::move(result);
+    return true;
+}
+
+bool QJsonSettings::exportJsonLines(QIODevice &dev, QIODevice &json) {
+    QByteArray data;
+    QJsonObject root;
+    if (!readJson(json, data) || !parseJson(data, root)) {
+        return false;
+    }
+
+    // Same walk as the reader, but the leaf values are written out as they are
+    struct Frame {
+        QJsonObject obj;
+        qsizetype index;
+        qsizetype groupSize;
+    };
+
+    const int maxDepth = maxNestingDepth.load(std::memory_order_relaxed);
+
+    QVarLengthArray<Frame, 32> stack;
+    QString group;
+    stack.append({root, 0, 0});
+    while (!stack.isEmpty()) {
+        auto &frame = stack.last();
+        if (frame.index == frame.obj.size()) {
+            group.truncate(frame.groupSize);
+            stack.removeLast();
+            continue;
+        }
+
+        // NOTE: copy the entry, "frame" is invalidated when a child is pushed
+        const auto it = frame.obj.constBegin() + frame.index++;
+        const QString key = unescapeKey(it.key());
+        QJsonValue value = it.value();
+        bool isBranch = key != kKeyValue && isBranchValue(value);
+
+        // Records stand on their own, so references are replaced by what they refer to. An
+        // object that isn't a valid reference is read as a group like before.
+        if (isReferenceValue(value)) {
+            QJsonValue target = value;
+            if (resolveJsonReference(root, target)) {
+                value = target;
+            } else {
+                isBranch = key != kKeyValue;
+            }
+        }
+        if (key == kKeyValue) {
+            if (!writeRecord(dev, group, value)) {
+                return false;
+            }
+        } else if (isBranch) {
+            if (stack.size() > maxDepth) {
+                return false;
+            }
+            const qsizetype groupSize = group.size();
+            if (!group.isEmpty()) {
+                group.append(kSeparator);
+            }
+            group.append(key);
+            stack.append({value.toObject(), 0, groupSize});
+        } else if (!writeRecord(dev, joinSettingsKey(group, key), value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QJsonSettings::importJsonLines(QIODevice &dev, QIODevice &json) {
+    // Records go straight into the tree, without collecting a flat map first
+    Writer tree;
+    QString key;
+    QJsonValue value;
+    bool ok = true;
+    while (readRecord(dev, key, value, ok)) {
+        QVariant variant = jsonValueToVariant(value, keyDepth(key), ok);
+        if (!ok) {
+            return false;
+        }
+        tree.insertPath(key, variant);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    QJsonObject obj;
+    if (!tree.toJsonObject(obj)) {
+        return false;
+    }
+    return json.write(writeJson(obj, tree.leafCount(), tree.branchCount())) != -1;
+}
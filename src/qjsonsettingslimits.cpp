@@ -0,0 +1,201 @@
+#include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QIODevice>
+#include <QtCore/QJsonDocument>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    static std::atomic<qint64> maxFileSizeLimit{0};
+
+    static std::atomic<qint64> maxKeysLimit{0};
+
+    static std::atomic<qint64> maxStringLengthLimit{0};
+
+    static std::atomic<qint64> maxElementsLimit{0};
+
+    static thread_local QJsonSettings::Error lastReadError;
+
+    // Small enough to stop early, large enough to keep the number of reads low
+    static constexpr qint64 kReadChunkSize = 64 * 1024;
+
+}
+
+namespace QJsonSettingsPrivate {
+
+    void setLastError(QJsonSettings::Error::Reason reason, qint64 offset) {
+        lastReadError = {reason, offset};
+    }
+
+    JsonLimitScanner::JsonLimitScanner()
+        : limits(QJsonSettings::limits()),
+          maxDepth(maxNestingDepth.load(std::memory_order_relaxed)),
+          active(limits.maxKeys > 0 || limits.maxStringLength > 0 || limits.maxElements > 0) {
+    }
+
+    bool JsonLimitScanner::checkSize(qint64 size) const {
+        if (limits.maxFileSize > 0 && size > limits.maxFileSize) {
+            setLastError(QJsonSettings::Error::FileTooLarge, limits.maxFileSize);
+            return false;
+        }
+        return true;
+    }
+
+    bool JsonLimitScanner::feed(const char *data, qsizetype size) {
+        // The document may have grown since its size was checked
+        if (!checkSize(offset + size)) {
+            return false;
+        }
+        if (!active) {
+            offset += size;
+            return true;
+        }
+
+        for (qsizetype i = 0; i < size; ++i) {
+            const char c = data[i];
+            if (inString) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                    continue;
+                } else if (c == '"') {
+                    inString = false;
+                    continue;
+                }
+                if (limits.maxStringLength > 0 && ++stringLength > limits.maxStringLength) {
+                    setLastError(QJsonSettings::Error::StringTooLong, offset + i);
+                    return false;
+                }
+                continue;
+            }
+
+            switch (c) {
+                case '"':
+                    inString = true;
+                    stringLength = 0;
+                    break;
+                case '{':
+                case '[':
+                    // The root object holds the top-level groups, so it doesn't count
+                    if (elements.size() > maxDepth) {
+                        setLastError(QJsonSettings::Error::TooDeep, offset + i);
+                        return false;
+                    }
+                    elements.append(0);
+                    break;
+                case '}':
+                case ']':
+                    if (!elements.isEmpty()) {
+                        elements.removeLast();
+                    }
+                    break;
+                case ',':
+                    // N separators separate N + 1 elements
+                    if (!elements.isEmpty() && limits.maxElements > 0 &&
+                        ++elements.last() >= limits.maxElements) {
+                        setLastError(QJsonSettings::Error::TooManyElements, offset + i);
+                        return false;
+                    }
+                    break;
+                case ':':
+                    if (limits.maxKeys > 0 && ++keys > limits.maxKeys) {
+                        setLastError(QJsonSettings::Error::TooManyKeys, offset + i);
+                        return false;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        offset += size;
+        return true;
+    }
+
+    bool readJson(QIODevice &dev, QByteArray &data,
+                  const std::function<bool(qint64)> &progress) {
+        setLastError(QJsonSettings::Error::NoError);
+
+        JsonLimitScanner scanner;
+        const qint64 remaining = dev.isSequential() ? -1 : dev.size() - dev.pos();
+        if (!scanner.checkSize(remaining)) {
+            return false;
+        }
+
+        const qsizetype estimated = qsizetype(remaining < 0 ? dev.bytesAvailable() : remaining);
+        if (!progress && !scanner.isActive() && (scanner.maxFileSize() <= 0 || remaining >= 0)) {
+            // QIODevice::readAll reads a random access device into a buffer of the remaining size
+            // in one go, only sequential devices are read in growing chunks
+            data = dev.readAll();
+            reportSizeEstimate(QJsonSettings::SizeEstimate::InputData, estimated, data.size());
+            return true;
+        }
+
+        // Read in chunks, so that a violation or the caller stops reading
+        data.clear();
+        data.reserve(qMax<qsizetype>(estimated, 0));
+        while (true) {
+            const qsizetype pos = data.size();
+            data.resize(pos + kReadChunkSize);
+            const qint64 count = dev.read(data.data() + pos, kReadChunkSize);
+            data.resize(pos + qMax<qint64>(count, 0));
+            if (count < 0) {
+                setLastError(QJsonSettings::Error::ReadError, pos);
+                return false;
+            }
+            if (count == 0) {
+                break;
+            }
+            if (!scanner.feed(data.constData() + pos, count)) {
+                return false;
+            }
+            if (progress && !progress(data.size())) {
+                return false;
+            }
+        }
+        reportSizeEstimate(QJsonSettings::SizeEstimate::InputData, estimated, data.size());
+        return true;
+    }
+
+    bool parseJson(const QByteArray &data, QJsonObject &obj) {
+        QJsonParseError error;
+        const QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+        if (error.error != QJsonParseError::NoError) {
+            setLastError(error.error == QJsonParseError::DeepNesting
+                             ? QJsonSettings::Error::TooDeep
+                             : QJsonSettings::Error::SyntaxError,
+                         error.offset);
+            return false;
+        }
+        if (!doc.isObject()) {
+            setLastError(QJsonSettings::Error::InvalidContent, 0);
+            return false;
+        }
+        obj = doc.object();
+        return true;
+    }
+
+}
+
+QJsonSettings::Limits QJsonSettings::limits() {
+    Limits result;
+    result.maxFileSize = maxFileSizeLimit.load(std::memory_order_relaxed);
+    result.maxKeys = maxKeysLimit.load(std::memory_order_relaxed);
+    result.maxStringLength = maxStringLengthLimit.load(std::memory_order_relaxed);
+    result.maxElements = maxElementsLimit.load(std::memory_order_relaxed);
+    return result;
+}
+
+void QJsonSettings::setLimits(const Limits &limits) {
+    maxFileSizeLimit.store(limits.maxFileSize, std::memory_order_relaxed);
+    maxKeysLimit.store(limits.maxKeys, std::memory_order_relaxed);
+    maxStringLengthLimit.store(limits.maxStringLength, std::memory_order_relaxed);
+    maxElementsLimit.store(limits.maxElements, std::memory_order_relaxed);
+}
+
+QJsonSettings::Error QJsonSettings::lastError() {
+    return lastReadError;
+}
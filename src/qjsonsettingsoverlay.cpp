@@ -0,0 +1,270 @@
+#include "qjsonsettingsoverlay.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QVarLengthArray>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    // Parsed layer, kept as long as the file has the same content
+    struct SharedLayer {
+        qsizetype size = 0;
+        quint64 hash = 0;
+        QJsonObject obj;
+    };
+
+    struct SharedLayerCache {
+        QMutex mutex;
+        QHash<QString, SharedLayer> layers;
+    };
+
+    static SharedLayerCache &sharedLayerCache() {
+        static SharedLayerCache cache;
+        return cache;
+    }
+
+    // The file is always read through the limited reader, the cache only saves parsing it. Its
+    // modification time isn't enough to tell whether it changed, a rewrite can keep it.
+    bool loadLayer(const QString &path, bool shared, QJsonObject &obj) {
+        const QFileInfo info(path);
+        if (!info.exists()) {
+            obj = {};
+            return true;
+        }
+
+        QFile file(path);
+        QByteArray data;
+        if (!file.open(QIODevice::ReadOnly) || !readJson(file, data)) {
+            return false;
+        }
+        if (!shared) {
+            return parseJson(data, obj);
+        }
+
+        auto &cache = sharedLayerCache();
+        const QString key = info.absoluteFilePath();
+        const quint64 hash = hashBytes(data.constData(), data.size());
+        {
+            QMutexLocker locker(&cache.mutex);
+            auto it = cache.layers.constFind(key);
+            if (it != cache.layers.constEnd() && it->size == data.size() && it->hash == hash) {
+                obj = it->obj;
+                return true;
+            }
+        }
+
+        if (!parseJson(data, obj)) {
+            return false;
+        }
+
+        QMutexLocker locker(&cache.mutex);
+        cache.layers.insert(key, {data.size(), hash, obj});
+        return true;
+    }
+
+    // Stacks "upper" on "lower" key by key: a value overrides a value, groups are merged, and a
+    // value meeting a group becomes or keeps the group's own value. Walks with an explicit stack,
+    // so a deep layer fails at the depth limit instead of overflowing the call stack.
+    bool mergeLayer(QJsonObject &lower, const QJsonObject &upper, int maxDepth) {
+        struct Frame {
+            QJsonObject lower;
+            QJsonObject upper;
+            qsizetype index;
+
+            // Key of the group in the parent frame
+            QString key;
+        };
+
+        QVarLengthArray<Frame, 16> stack;
+        stack.append({std::move(lower), upper, 0, {}});
+        while (true) {
+            auto &frame = stack.last();
+            if (frame.index == frame.upper.size()) {
+                if (stack.size() == 1) {
+                    lower = std::move(frame.lower);
+                    return true;
+                }
+                Frame done = std::move(frame);
+                stack.removeLast();
+                stack.last().lower.insert(done.key, done.lower);
+                continue;
+            }
+
+            // NOTE: copy the entry, "frame" is invalidated when a child is pushed
+            const auto it = frame.upper.constBegin() + frame.index++;
+            const QString key = it.key();
+            const QJsonValue value = it.value();
+            const QJsonValue lowerValue = frame.lower.value(key);
+            if (lowerValue.isUndefined()) {
+                frame.lower.insert(key, value);
+                continue;
+            }
+
+            const bool isBranch = key != kKeyValue && isBranchValue(value);
+            const bool isLowerBranch = key != kKeyValue && isBranchValue(lowerValue);
+            if (!isBranch) {
+                if (isLowerBranch) {
+                    QJsonObject branch = lowerValue.toObject();
+                    branch.insert(kKeyValue, value);
+                    frame.lower.insert(key, branch);
+                } else {
+                    frame.lower.insert(key, value);
+                }
+                continue;
+            }
+
+            if (isLowerBranch) {
+                if (stack.size() > maxDepth) {
+                    return false;
+                }
+                stack.append({lowerValue.toObject(), value.toObject(), 0, key});
+                continue;
+            }
+            QJsonObject branch = value.toObject();
+            if (!branch.contains(kKeyValue)) {
+                branch.insert(kKeyValue, lowerValue);
+            }
+            frame.lower.insert(key, branch);
+        }
+    }
+
+    // Returns the group at the path, or false if a segment is missing or not a group
+    bool findGroup(const QJsonObject &root, const SettingsKeys &keys, qsizetype count,
+                   QJsonObject &group) {
+        group = root;
+        for (qsizetype i = 0; i < count; ++i) {
+            const QJsonValue value = jsonMember(group, keys[i]);
+            if (!isBranchValue(value)) {
+                return false;
+            }
+            group = value.toObject();
+        }
+        return true;
+    }
+
+    bool findValue(const QJsonObject &root, const QString &key, QJsonValue &value, int &depth) {
+        if (!findJsonValue(root, key, value, &depth)) {
+            return false;
+        }
+        return !isReferenceValue(value) || resolveJsonReference(root, value, &depth);
+    }
+
+}
+
+class QJsonSettingsOverlayData : public QSharedData {
+public:
+    QStringList layers;
+    QJsonObject merged;
+};
+
+QJsonSettingsOverlay::QJsonSettingsOverlay() : d(new QJsonSettingsOverlayData()) {
+}
+
+QJsonSettingsOverlay::QJsonSettingsOverlay(const QJsonSettingsOverlay &other) = default;
+
+QJsonSettingsOverlay &QJsonSettingsOverlay::operator=(const QJsonSettingsOverlay &other) = default;
+
+QJsonSettingsOverlay::~QJsonSettingsOverlay() = default;
+
+bool QJsonSettingsOverlay::addLayer(const QString &path, bool shared) {
+    QJsonObject obj;
+    if (!loadLayer(path, shared, obj)) {
+        return false;
+    }
+
+    // The first layer is taken as is, so a single layer costs no more than the file itself
+    if (d->layers.isEmpty()) {
+        d->merged = std::move(obj);
+    } else {
+        QJsonObject merged = d->merged;
+        if (!mergeLayer(merged, obj, maxNestingDepth.load(std::memory_order_relaxed))) {
+            return false;
+        }
+        d->merged = std::move(merged);
+    }
+    d->layers.append(path);
+    return true;
+}
+
+QStringList QJsonSettingsOverlay::layers() const {
+    return d->layers;
+}
+
+QVariant QJsonSettingsOverlay::value(const QString &key, const QVariant &defaultValue) const {
+    QJsonValue value;
+    int depth = 0;
+    if (!findValue(d->merged, key, value, depth)) {
+        return defaultValue;
+    }
+    bool ok = true;
+    QVariant result = jsonValueToVariant(value, depth, ok);
+    return ok ? result : defaultValue;
+}
+
+bool QJsonSettingsOverlay::contains(const QString &key) const {
+    QJsonValue value;
+    int depth = 0;
+    return findValue(d->merged, key, value, depth);
+}
+
+QStringList QJsonSettingsOverlay::childKeys(const QString &group) const {
+    SettingsKeys keys;
+    splitSettingsPath(keys, group);
+    QJsonObject obj;
+    if (!findGroup(d->merged, keys, keys.size(), obj)) {
+        return {};
+    }
+
+    QStringList result;
+    for (auto it = obj.begin(); it != obj.end(); ++it) {
+        if (it.key() == kKeyValue) {
+            continue;
+        }
+        // A group with a value of its own is a key as well
+        const QJsonValue value = it.value();
+        if (!isBranchValue(value) || value.toObject().contains(kKeyValue)) {
+            result.append(unescapeKey(it.key()));
+        }
+    }
+    return result;
+}
+
+QStringList QJsonSettingsOverlay::childGroups(const QString &group) const {
+    SettingsKeys keys;
+    splitSettingsPath(keys, group);
+    QJsonObject obj;
+    if (!findGroup(d->merged, keys, keys.size(), obj)) {
+        return {};
+    }
+
+    QStringList result;
+    for (auto it = obj.begin(); it != obj.end(); ++it) {
+        const QJsonValue value = it.value();
+        if (it.key() == kKeyValue || !isBranchValue(value)) {
+            continue;
+        }
+        // A group holding only the value of the key itself is not a group
+        const QJsonObject child = value.toObject();
+        if (child.size() > (child.contains(kKeyValue) ? 1 : 0)) {
+            result.append(unescapeKey(it.key()));
+        }
+    }
+    return result;
+}
+
+QSettings::SettingsMap QJsonSettingsOverlay::toSettingsMap() const {
+    QSettings::SettingsMap result;
+    fromJsonObject(d->merged, result);
+    return result;
+}
+
+void QJsonSettingsOverlay::clearSharedLayers() {
+    auto &cache = sharedLayerCache();
+    QMutexLocker locker(&cache.mutex);
+    cache.layers.clear();
+}
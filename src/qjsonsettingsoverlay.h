@@ -0,0 +1,43 @@
+// Copyright (C) 2025 Stdware Collections (https://www.github.com/stdware)
+// SPDX-License-Identifier: MIT
+
+#ifndef QJSONSETTINGSOVERLAY_H
+#define QJSONSETTINGSOVERLAY_H
+
+#include <QtCore/QSettings>
+#include <QtCore/QSharedDataPointer>
+
+class QJsonSettingsOverlayData;
+
+// Read-only view of several JSON settings files stacked on top of each other, such as shipped
+// defaults, site-wide overrides and per-user settings. Upper layers override lower ones key by
+// key, and groups that only one layer touches are shared with that layer instead of copied.
+class QJsonSettingsOverlay {
+public:
+    QJsonSettingsOverlay();
+    QJsonSettingsOverlay(const QJsonSettingsOverlay &other);
+    QJsonSettingsOverlay &operator=(const QJsonSettingsOverlay &other);
+    ~QJsonSettingsOverlay();
+
+    // Stacks the file on top of the current layers. A missing file is an empty layer, returns
+    // false if the file can't be parsed or exceeds the limits of QJsonSettings. The file is read
+    // each time, shared layers are parsed once and kept in a process wide cache until the file's
+    // content changes. Pass false for files that are rewritten often.
+    bool addLayer(const QString &path, bool shared = true);
+    QStringList layers() const;
+
+    QVariant value(const QString &key, const QVariant &defaultValue = {}) const;
+    bool contains(const QString &key) const;
+    QStringList childKeys(const QString &group = {}) const;
+    QStringList childGroups(const QString &group = {}) const;
+
+    QSettings::SettingsMap toSettingsMap() const;
+
+    // Drops the cached shared layers
+    static void clearSharedLayers();
+
+private:
+    QSharedDataPointer<QJsonSettingsOverlayData> d;
+};
+
+#endif // QJSONSETTINGSOVERLAY_H
@@ -0,0 +1,238 @@
+#include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QDataStream>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    static constexpr quint32 kSnapshotMagic = 0x53534a51; // "QJSS"
+
+    // Bumped whenever the layout or the meaning of a snapshot changes
+    static constexpr quint32 kSnapshotVersion = 1;
+
+    // Fixed size header, the payload follows it and is the settings map written by QDataStream.
+    // Fields are in native byte order, a snapshot written on another architecture fails the
+    // magic check.
+    struct SnapshotHeader {
+        quint32 magic;
+        quint32 version;
+        quint32 streamVersion;
+        quint32 reserved;
+        qint64 jsonSize;
+        quint64 jsonHash;
+        qint64 payloadSize;
+        quint64 payloadHash;
+    };
+
+    QString snapshotPath(const QString &path) {
+        return path + QStringLiteral(".snapshot");
+    }
+
+    // QVariant asserts on types it can't save, so the values are checked before they're written
+    bool isStreamable(const QVariant &value) {
+        switch (value.userType()) {
+            case QMetaType::UnknownType:
+                return true;
+            case QMetaType::QVariantList: {
+                const auto &list = *static_cast<const QVariantList *>(value.constData());
+                return std::all_of(list.begin(), list.end(), isStreamable);
+            }
+            case QMetaType::QVariantMap: {
+                const auto &map = *static_cast<const QVariantMap *>(value.constData());
+                return std::all_of(map.begin(), map.end(), isStreamable);
+            }
+            case QMetaType::QVariantHash: {
+                const auto &hash = *static_cast<const QVariantHash *>(value.constData());
+                return std::all_of(hash.begin(), hash.end(), isStreamable);
+            }
+            default:
+                break;
+        }
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        return value.metaType().hasSaveOperator();
+#else
+        // Qt 5 can't tell without saving, a stream without a device drops what's written
+        QDataStream probe;
+        return QMetaType::save(probe, value.userType(), value.constData());
+#endif
+    }
+
+    // Whether the key is read back as it is, empty segments are dropped and reserved names may be
+    // read as part of a value
+    inline bool keyReadsBackAsIs(QStringView key) {
+        return !key.isEmpty() && !key.startsWith(kSeparator) && !key.endsWith(kSeparator) &&
+               !key.contains(u"//") && !key.contains(u'$');
+    }
+
+    // Whether the value is read back from JSON with the same type and value
+    bool valueReadsBackAsIs(const QVariant &value) {
+        switch (value.userType()) {
+            case QMetaType::Bool:
+            case QMetaType::QString:
+            case QMetaType::QStringList:
+            case QMetaType::QByteArray:
+            case QMetaType::QRect:
+            case QMetaType::QSize:
+            case QMetaType::QPoint:
+            case QMetaType::QLine:
+                return true;
+            case QMetaType::Double:
+                return std::isfinite(*static_cast<const double *>(value.constData()));
+            default:
+                break;
+        }
+        return false;
+    }
+
+    // The settings as they're read back from the JSON written for them. Values read back as they
+    // are come from the caller's settings, only the others are decoded from the JSON.
+    bool readBack(const QSettings::SettingsMap &settings, const QJsonObject &obj,
+                  QSettings::SettingsMap &result) {
+        result = settings;
+        for (auto it = settings.cbegin(); it != settings.cend(); ++it) {
+            if (!keyReadsBackAsIs(it.key())) {
+                return fromJsonObject(obj, result);
+            }
+            if (valueReadsBackAsIs(it.value())) {
+                continue;
+            }
+            QJsonValue value;
+            int depth = 0;
+            if (!findJsonValue(obj, it.key(), value, &depth) ||
+                (isReferenceValue(value) && !resolveJsonReference(obj, value, &depth))) {
+                return fromJsonObject(obj, result);
+            }
+            bool ok = true;
+            result.insert(it.key(), jsonValueToVariant(value, depth, ok));
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+namespace QJsonSettingsPrivate {
+
+    quint64 hashBytes(const char *data, qsizetype size) {
+        quint64 hash = 0xcbf29ce484222325ull;
+        qsizetype i = 0;
+        for (; i + 8 <= size; i += 8) {
+            quint64 word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        for (; i < size; ++i) {
+            hash = (hash ^ quint8(data[i])) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    bool readSnapshot(const QString &path, const QByteArray &json,
+                      QSettings::SettingsMap &settings, const QJsonSettingsSchema *schema) {
+        // The snapshot holds what a read without a schema returns
+        if (schema && (!schema->isEmpty() ||
+                       schema->unknownKeyPolicy() != QJsonSettingsSchema::DecodeUnknownKeys)) {
+            return false;
+        }
+
+        QFile file(snapshotPath(path));
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        const qint64 size = file.size();
+        if (size < qint64(sizeof(SnapshotHeader))) {
+            return false;
+        }
+
+        // The mapping is released when the file is closed
+        const uchar *data = file.map(0, size);
+        if (!data) {
+            return false;
+        }
+
+        SnapshotHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        const char *payload = reinterpret_cast<const char *>(data) + sizeof(header);
+        if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion ||
+            header.streamVersion > quint32(QDataStream::Qt_DefaultCompiledVersion) ||
+            header.payloadSize != size - qint64(sizeof(header)) ||
+            header.jsonSize != json.size() ||
+            header.jsonHash != hashBytes(json.constData(), json.size()) ||
+            header.payloadHash != hashBytes(payload, qsizetype(header.payloadSize))) {
+            return false;
+        }
+
+        // Stream straight from the mapped pages
+        const QByteArray bytes = QByteArray::fromRawData(payload, qsizetype(header.payloadSize));
+        QDataStream stream(bytes);
+        stream.setVersion(int(header.streamVersion));
+        QVariantMap result;
+        stream >> result;
+        if (stream.status() != QDataStream::Ok || !stream.atEnd()) {
+            return false;
+        }
+        settings = std::move(result);
+        return true;
+    }
+
+    void writeSnapshot(const QString &path, const QByteArray &json, const QJsonObject &obj,
+                       const QSettings::SettingsMap &written) {
+        if (path.isEmpty()) {
+            return;
+        }
+
+        // Take the settings as they'll be read back, not as they were written
+        QSettings::SettingsMap settings;
+        if (!readBack(written, obj, settings) ||
+            !std::all_of(settings.cbegin(), settings.cend(), isStreamable)) {
+            std::ignore = QFile::remove(snapshotPath(path));
+            return;
+        }
+
+        QByteArray payload;
+        {
+            QDataStream stream(&payload, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_DefaultCompiledVersion);
+            stream << settings;
+            if (stream.status() != QDataStream::Ok) {
+                std::ignore = QFile::remove(snapshotPath(path));
+                return;
+            }
+        }
+
+        SnapshotHeader header = {};
+        header.magic = kSnapshotMagic;
+        header.version = kSnapshotVersion;
+        header.streamVersion = quint32(QDataStream::Qt_DefaultCompiledVersion);
+        header.jsonSize = json.size();
+        header.jsonHash = hashBytes(json.constData(), json.size());
+        header.payloadSize = payload.size();
+        header.payloadHash = hashBytes(payload.constData(), payload.size());
+
+        // A stale snapshot never matches the new content, so a failed write is harmless
+        QSaveFile file(snapshotPath(path));
+        if (!file.open(QIODevice::WriteOnly)) {
+            return;
+        }
+        if (file.write(reinterpret_cast<const char *>(&header), sizeof(header)) !=
+                qint64(sizeof(header)) ||
+            file.write(payload) != payload.size()) {
+            file.cancelWriting();
+            return;
+        }
+        std::ignore = file.commit();
+    }
+
+}
@@ -0,0 +1,316 @@
+#include "qjsonsettingsstore.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDeadlineTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QIODevice>
+#include <QtCore/QLockFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QSet>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    bool parseTree(const QByteArray &data, Writer &tree) {
+        QJsonObject obj;
+        if (!parseJson(data, obj)) {
+            return false;
+        }
+        if (!tree.load(obj, data.size())) {
+            setLastError(QJsonSettings::Error::InvalidContent);
+            return false;
+        }
+        return true;
+    }
+
+    bool readTree(QIODevice &dev, Writer &tree) {
+        QByteArray data;
+        return readJson(dev, data) && parseTree(data, tree);
+    }
+
+    // Syncs that find the file changed again between reading it and taking the lock merge again,
+    // this many times at most
+    static constexpr int kMaxSyncAttempts = 8;
+
+    // SHA-256 of the contents of a file, tells whether it changed when its stamp doesn't: within
+    // the resolution of the modification time, or when the size and time were kept. Empty if the
+    // file doesn't exist.
+    QByteArray contentDigest(const FileStamp &stamp, const QByteArray &data) {
+        return stamp.size < 0 ? QByteArray()
+                              : QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    }
+
+    // A file that doesn't exist reads as empty, the stamp is taken before reading so that a
+    // concurrent change is seen by the next check
+    bool readContents(const QString &path, QByteArray &data, FileStamp &stamp,
+                      QByteArray &digest) {
+        stamp = FileStamp::of(path);
+        data.clear();
+        if (stamp.size >= 0) {
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly) || !readJson(file, data)) {
+                return false;
+            }
+        }
+        digest = contentDigest(stamp, data);
+        return true;
+    }
+
+    bool parseContents(const FileStamp &stamp, const QByteArray &data, Writer &tree) {
+        if (stamp.size < 0) {
+            tree.clear();
+            return true;
+        }
+        return parseTree(data, tree);
+    }
+
+    bool writeTree(const Writer &tree, QByteArray &data) {
+        QJsonObject obj;
+        if (!tree.toJsonObject(obj)) {
+            return false;
+        }
+        data = writeJson(obj, tree.leafCount(), tree.branchCount());
+        return true;
+    }
+
+    bool writeTree(QIODevice &dev, const Writer &tree) {
+        QByteArray data;
+        return writeTree(tree, data) && dev.write(data) != -1;
+    }
+
+    bool writeTree(const QString &path, const Writer &tree, QByteArray &data) {
+        if (!writeTree(tree, data)) {
+            return false;
+        }
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        if (file.write(data) == -1) {
+            file.cancelWriting();
+            return false;
+        }
+        return file.commit();
+    }
+
+    // Replaces the group's subtree in "to" with the one in "from"
+    void copyGroup(const Writer &from, Writer &to, const QString &group) {
+        to.remove(group);
+
+        QVariant value;
+        if (!group.isEmpty() && from.find(group, &value)) {
+            to.setValue(group, value);
+        }
+        QStringList pending = {group};
+        while (!pending.isEmpty()) {
+            const QString current = pending.takeLast();
+            for (const auto &key : from.childKeys(current)) {
+                const QString path = joinSettingsKey(current, key);
+                if (from.find(path, &value)) {
+                    to.setValue(path, value);
+                }
+            }
+            for (const auto &child : from.childGroups(current)) {
+                pending.append(joinSettingsKey(current, child));
+            }
+        }
+    }
+
+}
+
+class QJsonSettingsStoreData : public QSharedData {
+public:
+    Writer tree;
+
+    // Keys set and groups removed since the file was last read, the merge takes their current
+    // values in the tree, so only the latest change of a key matters
+    QSet<QString> changedKeys;
+    QSet<QString> changedGroups;
+
+    // File the tree was last read from or synced with, and its state and contents at the time
+    QString path;
+    FileStamp stamp;
+    QByteArray digest;
+
+    void reset(Writer &&newTree, const QString &newPath = {}, const FileStamp &newStamp = {},
+               const QByteArray &newDigest = {}) {
+        tree = std::move(newTree);
+        changedKeys.clear();
+        changedGroups.clear();
+        path = newPath;
+        stamp = newStamp;
+        digest = newDigest;
+    }
+
+    // Applies the changes of the tree to a newer version of the file
+    void mergeInto(Writer &target) const {
+        for (const auto &group : changedGroups) {
+            copyGroup(tree, target, group);
+        }
+        for (const auto &key : changedKeys) {
+            // Keys missing from the tree were removed with one of the groups
+            QVariant value;
+            if (tree.find(key, &value)) {
+                target.setValue(key, value);
+            }
+        }
+    }
+};
+
+QJsonSettingsStore::QJsonSettingsStore() : d(new QJsonSettingsStoreData()) {
+}
+
+QJsonSettingsStore::QJsonSettingsStore(const QJsonSettingsStore &other) = default;
+
+QJsonSettingsStore &QJsonSettingsStore::operator=(const QJsonSettingsStore &other) = default;
+
+QJsonSettingsStore::~QJsonSettingsStore() = default;
+
+QVariant QJsonSettingsStore::value(const QString &key, const QVariant &defaultValue) const {
+    QVariant value;
+    return d->tree.find(key, &value) ? value : defaultValue;
+}
+
+void QJsonSettingsStore::setValue(const QString &key, const QVariant &value) {
+    d->tree.setValue(key, value);
+    d->changedKeys.insert(normalizedKey(key));
+}
+
+bool QJsonSettingsStore::contains(const QString &key) const {
+    return d->tree.find(key);
+}
+
+void QJsonSettingsStore::remove(const QString &key) {
+    d->tree.remove(key);
+    d->changedGroups.insert(normalizedKey(key));
+}
+
+void QJsonSettingsStore::clear() {
+    d->tree.clear();
+    d->changedGroups.insert(QString());
+}
+
+bool QJsonSettingsStore::isEmpty() const {
+    return d->tree.isEmpty();
+}
+
+QStringList QJsonSettingsStore::childKeys(const QString &group) const {
+    return d->tree.childKeys(group);
+}
+
+QStringList QJsonSettingsStore::childGroups(const QString &group) const {
+    return d->tree.childGroups(group);
+}
+
+QSettings::SettingsMap QJsonSettingsStore::toSettingsMap() const {
+    return d->tree.toVariantMap();
+}
+
+bool QJsonSettingsStore::load(QIODevice &dev) {
+    Writer tree;
+    if (!readTree(dev, tree)) {
+        return false;
+    }
+    d->reset(std::move(tree));
+    return true;
+}
+
+bool QJsonSettingsStore::load(const QString &path) {
+    // Loading the same file again is free while it's unchanged
+    const FileStamp stamp = FileStamp::of(path);
+    if (stamp.size < 0) {
+        return false;
+    }
+    if (path == d->path && stamp == d->stamp && d->changedKeys.isEmpty() &&
+        d->changedGroups.isEmpty()) {
+        return true;
+    }
+
+    QByteArray data;
+    FileStamp newStamp;
+    QByteArray digest;
+    Writer tree;
+    if (!readContents(path, data, newStamp, digest) || newStamp.size < 0 ||
+        !parseTree(data, tree)) {
+        return false;
+    }
+    d->reset(std::move(tree), path, newStamp, digest);
+    return true;
+}
+
+bool QJsonSettingsStore::save(QIODevice &dev) const {
+    return writeTree(dev, d->tree);
+}
+
+bool QJsonSettingsStore::save(const QString &path) const {
+    QByteArray data;
+    return writeTree(path, d->tree, data);
+}
+
+bool QJsonSettingsStore::sync(const QString &path, int timeout) {
+    // Read the other processes' changes, merge them and write the result to a temporary file
+    // before taking the lock. Under the lock the file is only read again, compared and replaced.
+    bool isCurrent = path == d->path && FileStamp::of(path) == d->stamp;
+    QByteArray contents;
+    FileStamp stamp = d->stamp;
+    QByteArray digest = d->digest;
+    if (!isCurrent && !readContents(path, contents, stamp, digest)) {
+        return false;
+    }
+
+    const bool hasChanges = !d->changedKeys.isEmpty() || !d->changedGroups.isEmpty();
+    const QDeadlineTimer deadline(timeout);
+    for (int attempt = 0; attempt < kMaxSyncAttempts; ++attempt) {
+        Writer merged;
+        if (isCurrent) {
+            merged = d->tree;
+        } else {
+            if (!parseContents(stamp, contents, merged)) {
+                return false;
+            }
+            d->mergeInto(merged);
+        }
+        if (!hasChanges) {
+            d->reset(std::move(merged), path, stamp, digest);
+            return true;
+        }
+
+        // Discarded unless it's committed
+        QByteArray data;
+        QSaveFile file(path);
+        if (!writeTree(merged, data) || !file.open(QIODevice::WriteOnly) ||
+            file.write(data) == -1) {
+            return false;
+        }
+
+        QLockFile lock(path + QStringLiteral(".lock"));
+        if (!lock.tryLock(int(qMin<qint64>(deadline.remainingTime(), INT_MAX)))) {
+            return false;
+        }
+
+        // The stamp can stay the same across a change, so the contents are compared
+        FileStamp lockedStamp;
+        QByteArray lockedDigest;
+        if (!readContents(path, contents, lockedStamp, lockedDigest)) {
+            return false;
+        }
+        if (lockedDigest == digest) {
+            if (!file.commit()) {
+                return false;
+            }
+            stamp = FileStamp::of(path);
+            d->reset(std::move(merged), path, stamp, contentDigest(stamp, data));
+            return true;
+        }
+
+        // Changed since it was read, merge with the new contents after releasing the lock
+        stamp = lockedStamp;
+        digest = lockedDigest;
+        isCurrent = false;
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+// Copyright (C) 2025 Stdware Collections (https://www.github.com/stdware)
+// SPDX-License-Identifier: MIT
+
+#ifndef QJSONSETTINGSSTORE_H
+#define QJSONSETTINGSSTORE_H
+
+#include <QtCore/QSettings>
+#include <QtCore/QSharedDataPointer>
+
+class QIODevice;
+
+class QJsonSettingsStoreData;
+
+// Hierarchical settings kept as a tree of groups, without going through QSettings. Keys are
+// looked up in O(depth), groups are listed in O(children), and the tree is loaded from and saved
+// to JSON directly instead of through a flat map of full paths. Loaded values are decoded when
+// they're first read, so a store and the copies sharing its data can't be read from several
+// threads at once.
+class QJsonSettingsStore {
+public:
+    QJsonSettingsStore();
+    QJsonSettingsStore(const QJsonSettingsStore &other);
+    QJsonSettingsStore &operator=(const QJsonSettingsStore &other);
+    ~QJsonSettingsStore();
+
+    QVariant value(const QString &key, const QVariant &defaultValue = {}) const;
+    void setValue(const QString &key, const QVariant &value);
+    bool contains(const QString &key) const;
+
+    // Removes the key and all of its subkeys, an empty key clears the store
+    void remove(const QString &key);
+    void clear();
+    bool isEmpty() const;
+
+    QStringList childKeys(const QString &group = {}) const;
+    QStringList childGroups(const QString &group = {}) const;
+
+    QSettings::SettingsMap toSettingsMap() const;
+
+    // The store is left unchanged if loading fails
+    bool load(QIODevice &dev);
+    bool load(const QString &path);
+    bool save(QIODevice &dev) const;
+    bool save(const QString &path) const;
+
+    // Merges the keys changed since the file was last loaded or synced into the file's current
+    // content, and reloads the store with the result. Keys changed by other processes in the
+    // meantime are kept, keys changed on both sides take the store's value. The result is written
+    // to a temporary file first. Concurrent syncs are serialized by "<path>.lock", which is only
+    // held while the file's content is compared with what was merged and the temporary file
+    // replaces it. If the file changed, the merge is retried. Returns false if the lock isn't
+    // taken within the timeout in milliseconds.
+    bool sync(const QString &path, int timeout = 5000);
+
+private:
+    QSharedDataPointer<QJsonSettingsStoreData> d;
+};
+
+#endif // QJSONSETTINGSSTORE_H
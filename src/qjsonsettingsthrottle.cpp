@@ -0,0 +1,128 @@
+#include "qjsonsettingsthrottle.h"
+#include "qjsonsettings_p.h"
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    // Delay before a failed write is attempted again
+    static constexpr int kRetryInterval = 1000;
+
+}
+
+QJsonSettingsThrottle::QJsonSettingsThrottle(const QString &path, QObject *parent)
+    : QObject(parent), filePath(path) {
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, this, [this]() { std::ignore = flush(); });
+    clock.start();
+
+    // A file that doesn't exist yet starts out empty
+    std::ignore = store.load(path);
+}
+
+QJsonSettingsThrottle::~QJsonSettingsThrottle() {
+    // Nothing can be connected to a signal emitted here any more
+    if (!dirty.isEmpty()) {
+        std::ignore = store.sync(filePath);
+    }
+}
+
+QString QJsonSettingsThrottle::path() const {
+    return filePath;
+}
+
+QVariant QJsonSettingsThrottle::value(const QString &key, const QVariant &defaultValue) const {
+    return store.value(key, defaultValue);
+}
+
+void QJsonSettingsThrottle::setValue(const QString &key, const QVariant &value) {
+    store.setValue(key, value);
+    markDirty(normalizedKey(key));
+}
+
+bool QJsonSettingsThrottle::contains(const QString &key) const {
+    return store.contains(key);
+}
+
+void QJsonSettingsThrottle::remove(const QString &key) {
+    store.remove(key);
+    markDirty(normalizedKey(key));
+}
+
+void QJsonSettingsThrottle::setWriteInterval(const QString &group, int msecs) {
+    intervals.insert(normalizedKey(group), qMax(0, msecs));
+}
+
+int QJsonSettingsThrottle::writeInterval(const QString &key) const {
+    return intervals.value(intervalGroup(normalizedKey(key)));
+}
+
+QStringList QJsonSettingsThrottle::dirtyKeys() const {
+    QStringList result(dirty.begin(), dirty.end());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool QJsonSettingsThrottle::isDirty() const {
+    return !dirty.isEmpty();
+}
+
+bool QJsonSettingsThrottle::flush() {
+    timer.stop();
+    if (dirty.isEmpty()) {
+        return true;
+    }
+
+    // Only the changed keys are merged into the file's current content
+    const bool ok = store.sync(filePath);
+    if (ok) {
+        const qint64 now = clock.elapsed();
+        for (const auto &key : std::as_const(dirty)) {
+            lastWrites.insert(intervalGroup(key), now);
+        }
+        dirty.clear();
+    } else {
+        // The file may be locked or unwritable for a while, without a retry the changes would
+        // wait for the next one
+        deadline = clock.elapsed() + kRetryInterval;
+        timer.start(kRetryInterval);
+    }
+    Q_EMIT written(ok);
+    return ok;
+}
+
+// Innermost key or group with an interval, the empty group if there's none
+QString QJsonSettingsThrottle::intervalGroup(const QString &key) const {
+    QStringView group(key);
+    while (!group.isEmpty()) {
+        if (intervals.contains(group.toString())) {
+            return group.toString();
+        }
+        const qsizetype index = group.lastIndexOf(kSeparator);
+        group = group.left(qMax<qsizetype>(index, 0));
+    }
+    return {};
+}
+
+void QJsonSettingsThrottle::markDirty(const QString &key) {
+    dirty.insert(key);
+
+    // The change is due one interval after the last write it caused, the earliest due change
+    // triggers the write of all of them
+    const QString group = intervalGroup(key);
+    const qint64 now = clock.elapsed();
+    qint64 due = now;
+    auto it = lastWrites.constFind(group);
+    if (it != lastWrites.constEnd()) {
+        due = qMax(now, it.value() + intervals.value(group));
+    }
+    if (!timer.isActive() || due < deadline) {
+        deadline = due;
+        timer.start(int(qMin<qint64>(due - now, std::numeric_limits<int>::max())));
+    }
+}
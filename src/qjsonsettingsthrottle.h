@@ -0,0 +1,71 @@
+// Copyright (C) 2025 Stdware Collections (https://www.github.com/stdware)
+// SPDX-License-Identifier: MIT
+
+#ifndef QJSONSETTINGSTHROTTLE_H
+#define QJSONSETTINGSTHROTTLE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+
+#include "qjsonsettingsstore.h"
+
+// Settings file written in coalesced batches. Changed keys are tracked and merged into the file
+// by "QJsonSettingsStore::sync", so a write never converts the whole settings. A change waits
+// for the write interval of its key, so a burst of changes to a high-frequency value such as a
+// splitter position turns into at most one write per interval.
+class QJsonSettingsThrottle : public QObject {
+    Q_OBJECT
+public:
+    explicit QJsonSettingsThrottle(const QString &path, QObject *parent = nullptr);
+
+    // Writes the pending changes, without emitting "written"
+    ~QJsonSettingsThrottle() override;
+
+    QString path() const;
+
+    QVariant value(const QString &key, const QVariant &defaultValue = {}) const;
+    void setValue(const QString &key, const QVariant &value);
+    bool contains(const QString &key) const;
+
+    // Removes the key and all of its subkeys
+    void remove(const QString &key);
+
+    // Minimum time in milliseconds between writes caused by changes to the key or to keys in
+    // the group, the innermost key or group with an interval applies. The empty group holds the
+    // default, which is 0: changes are written once control returns to the event loop.
+    void setWriteInterval(const QString &group, int msecs);
+    int writeInterval(const QString &key) const;
+
+    // Keys and groups changed since the last write
+    QStringList dirtyKeys() const;
+    bool isDirty() const;
+
+    // Writes the pending changes right away. A failed write keeps them for the next attempt,
+    // made after a second or with the next change or flush, whichever comes first.
+    bool flush();
+
+Q_SIGNALS:
+    void written(bool ok);
+
+private:
+    QString intervalGroup(const QString &key) const;
+    void markDirty(const QString &key);
+
+    QString filePath;
+    QJsonSettingsStore store;
+
+    QHash<QString, int> intervals;
+
+    // Time of the last write caused by each key or group with an interval
+    QHash<QString, qint64> lastWrites;
+
+    QSet<QString> dirty;
+    QTimer timer;
+    QElapsedTimer clock;
+    qint64 deadline = 0;
+};
+
+#endif // QJSONSETTINGSTHROTTLE_H
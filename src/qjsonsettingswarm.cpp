@@ -0,0 +1,209 @@
+#include "qjsonsettings.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QFutureInterface>
+
+#ifdef Q_OS_UNIX
+#  include <sys/mman.h>
+#endif
+
+using namespace QJsonSettingsPrivate;
+
+// UTILS
+namespace {
+
+    // Entries that aren't taken are dropped once there are more than this many, oldest first, or
+    // once they're older than the maximum age
+    static constexpr qsizetype kMaxWarmEntries = 16;
+
+    static constexpr qint64 kMaxWarmAge = 5 * 60 * 1000;
+
+    // File read ahead of time, kept until a read of the file takes it
+    struct WarmEntry {
+        // Size and hash of the content the entry was prepared from
+        qint64 size = -1;
+        quint64 hash = 0;
+        QJsonSettingsSchema schema;
+        QElapsedTimer age;
+
+        // The parsed file and the settings of the groups converted so far, all of them if the
+        // entry is complete
+        QJsonObject document;
+        QStringList groups;
+        QSettings::SettingsMap settings;
+        bool complete = false;
+    };
+
+    struct WarmCache {
+        QMutex mutex;
+        QHash<QString, WarmEntry> entries;
+
+        // Makes room for an entry, the caller holds the mutex
+        void prune() {
+            for (auto it = entries.begin(); it != entries.end();) {
+                it = it->age.hasExpired(kMaxWarmAge) ? entries.erase(it) : std::next(it);
+            }
+            if (entries.size() < kMaxWarmEntries) {
+                return;
+            }
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                if (it->age.elapsed() > oldest->age.elapsed()) {
+                    oldest = it;
+                }
+            }
+            entries.erase(oldest);
+        }
+    };
+
+    static WarmCache &warmCache() {
+        static WarmCache cache;
+        return cache;
+    }
+
+    inline QString cacheKey(const QString &path) {
+        return QFileInfo(path).absoluteFilePath();
+    }
+
+    // Maps the file and asks the system to read its pages ahead, so the parser reads from memory
+    // instead of waiting on the disk page by page. Falls back to reading the file if it can't be
+    // mapped. The data refers to the mapping, which is released when the file is closed.
+    bool mapJson(QFile &file, QByteArray &data) {
+        setLastError(QJsonSettings::Error::NoError);
+        JsonLimitScanner scanner;
+        const qint64 size = file.size();
+        if (!scanner.checkSize(size)) {
+            return false;
+        }
+
+        uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+        if (!mapped) {
+            return readJson(file, data);
+        }
+#ifdef Q_OS_UNIX
+        posix_madvise(mapped, size_t(size), POSIX_MADV_WILLNEED);
+#endif
+        data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), qsizetype(size));
+        return scanner.feed(data.constData(), data.size());
+    }
+
+    class WarmTask : public QRunnable {
+    public:
+        WarmTask(const QString &path, const QStringList &prefixes)
+            : path(path), prefixes(prefixes) {
+            promise.reportStarted();
+        }
+
+        void run() override {
+            promise.reportResult(warmImpl());
+            promise.reportFinished();
+        }
+
+        QFutureInterface<bool> promise;
+
+    private:
+        bool warmImpl() {
+            WarmEntry entry;
+            entry.schema = QJsonSettings::schema();
+
+            QFile file(path);
+            if (promise.isCanceled() || !file.open(QIODevice::ReadOnly)) {
+                return false;
+            }
+            QByteArray data;
+            if (!mapJson(file, data) || !parseJson(data, entry.document)) {
+                return false;
+            }
+            // The read compares the content it reads with the one the entry is prepared from
+            entry.size = data.size();
+            entry.hash = hashBytes(data.constData(), data.size());
+            if (promise.isCanceled()) {
+                return false;
+            }
+
+            // An empty prefix selects the whole file
+            for (const auto &prefix : std::as_const(prefixes)) {
+                const QString group = normalizedKey(prefix);
+                if (group.isEmpty()) {
+                    entry.groups.clear();
+                    break;
+                }
+                entry.groups.append(group);
+            }
+
+            if (entry.groups.isEmpty()) {
+                if (!fromJsonObject(entry.document, entry.settings, &entry.schema)) {
+                    setLastError(QJsonSettings::Error::InvalidContent);
+                    return false;
+                }
+                entry.document = {};
+                entry.complete = true;
+            } else if (!fromJsonGroups(entry.document, entry.settings, &entry.schema, entry.groups,
+                                       OnlyGroups)) {
+                // Groups with references are left to the read, only the parse is saved
+                entry.groups.clear();
+                entry.settings.clear();
+            }
+
+            auto &cache = warmCache();
+            QMutexLocker locker(&cache.mutex);
+            const QString key = cacheKey(path);
+            cache.entries.remove(key);
+            cache.prune();
+            entry.age.start();
+            cache.entries.insert(key, std::move(entry));
+            return true;
+        }
+
+        QString path;
+        QStringList prefixes;
+    };
+
+}
+
+namespace QJsonSettingsPrivate {
+
+    bool takeWarmed(const QString &path, const QByteArray &json, QSettings::SettingsMap &settings,
+                    const QJsonSettingsSchema &schema) {
+        WarmEntry entry;
+        {
+            auto &cache = warmCache();
+            QMutexLocker locker(&cache.mutex);
+            if (cache.entries.isEmpty()) {
+                return false;
+            }
+            auto it = cache.entries.find(cacheKey(path));
+            if (it == cache.entries.end()) {
+                return false;
+            }
+            entry = std::move(it.value());
+            cache.entries.erase(it);
+        }
+
+        if (entry.age.hasExpired(kMaxWarmAge) || entry.size != json.size() ||
+            entry.hash != hashBytes(json.constData(), json.size()) ||
+            QJsonSettingsSchemaData::get(entry.schema) != QJsonSettingsSchemaData::get(schema)) {
+            return false;
+        }
+        if (!entry.complete && !fromJsonGroups(entry.document, entry.settings, &schema,
+                                               entry.groups, SkipGroups)) {
+            return false;
+        }
+        setLastError(QJsonSettings::Error::NoError);
+        settings = std::move(entry.settings);
+        return true;
+    }
+
+}
+
+QFuture<bool> QJsonSettings::warm(const QString &path, const QStringList &prefixes) {
+    auto task = new WarmTask(path, prefixes);
+    auto future = task->promise.future();
+    QThreadPool::globalInstance()->start(task);
+    return future;
+}
@@ -0,0 +1,142 @@
+#include "qjsonsettingswatcher.h"
+#include "qjsonsettings_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonArray>
+
+// UTILS
+namespace {
+
+    size_t contentHash(const QJsonValue &value) {
+        // Objects keep their keys sorted, so the compact form is canonical
+        QJsonDocument doc;
+        if (value.isObject()) {
+            doc.setObject(value.toObject());
+        } else {
+            doc.setArray(QJsonArray{value});
+        }
+        return qHash(doc.toJson(QJsonDocument::Compact));
+    }
+
+}
+
+QJsonSettingsWatcher::QJsonSettingsWatcher(const QString &path, QObject *parent)
+    : QObject(parent), filePath(QFileInfo(path).absoluteFilePath()) {
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, [this]() {
+        updateWatchedPaths();
+        reload();
+    });
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, this, [this]() {
+        // The file is replaced by renaming when QSettings saves it atomically, which drops it
+        // from the watch list, so pick it up again from the directory
+        if (!watcher.files().contains(filePath) && QFile::exists(filePath)) {
+            updateWatchedPaths();
+            reload();
+        }
+    });
+
+    updateWatchedPaths();
+    reload();
+}
+
+QJsonSettingsWatcher::~QJsonSettingsWatcher() = default;
+
+QString QJsonSettingsWatcher::path() const {
+    return filePath;
+}
+
+QSettings::SettingsMap QJsonSettingsWatcher::settings() const {
+    QSettings::SettingsMap result;
+    for (const auto &branch : branches) {
+        for (auto it = branch.settings.begin(); it != branch.settings.end(); ++it) {
+            result.insert(it.key(), it.value());
+        }
+    }
+    return result;
+}
+
+QStringList QJsonSettingsWatcher::reload() {
+    QJsonObject obj;
+    {
+        QFile file(filePath);
+        QByteArray data;
+        if (file.open(QIODevice::ReadOnly) && (!QJsonSettingsPrivate::readJson(file, data) ||
+                                               !QJsonSettingsPrivate::parseJson(data, obj))) {
+            // Over the limits, or probably caught in the middle of a write, wait for the next
+            // notification
+            return {};
+        }
+    }
+
+    QStringList changedKeys;
+    QHash<QString, Branch> newBranches;
+    newBranches.reserve(obj.size());
+    for (auto it = obj.begin(); it != obj.end(); ++it) {
+        const auto &key = it.key();
+        Branch branch;
+        branch.hash = contentHash(it.value());
+
+        auto orgIt = branches.constFind(key);
+        if (orgIt != branches.constEnd() && orgIt->hash == branch.hash) {
+            newBranches.insert(key, *orgIt);
+            continue;
+        }
+
+        QJsonObject branchObj;
+        branchObj.insert(key, it.value());
+        if (!QJsonSettingsPrivate::fromJsonObject(branchObj, branch.settings)) {
+            // Keep the last values of a branch that no longer decodes rather than report them
+            // removed, it's decoded again with the next change
+            if (orgIt != branches.constEnd()) {
+                newBranches.insert(key, *orgIt);
+            }
+            continue;
+        }
+
+        // Compare the decoded values key by key
+        if (orgIt == branches.constEnd()) {
+            changedKeys << branch.settings.keys();
+        } else {
+            const auto &orgSettings = orgIt->settings;
+            for (auto it1 = branch.settings.begin(); it1 != branch.settings.end(); ++it1) {
+                auto orgIt1 = orgSettings.find(it1.key());
+                if (orgIt1 == orgSettings.end() || orgIt1.value() != it1.value()) {
+                    changedKeys << it1.key();
+                }
+            }
+            for (auto it1 = orgSettings.begin(); it1 != orgSettings.end(); ++it1) {
+                if (!branch.settings.contains(it1.key())) {
+                    changedKeys << it1.key();
+                }
+            }
+        }
+        newBranches.insert(key, std::move(branch));
+    }
+
+    // Removed branches
+    for (auto it = branches.begin(); it != branches.end(); ++it) {
+        if (!newBranches.contains(it.key())) {
+            changedKeys << it->settings.keys();
+        }
+    }
+
+    branches = std::move(newBranches);
+
+    if (!changedKeys.isEmpty()) {
+        changedKeys.sort();
+        Q_EMIT changed(changedKeys);
+    }
+    return changedKeys;
+}
+
+void QJsonSettingsWatcher::updateWatchedPaths() {
+    const QString dirPath = QFileInfo(filePath).absolutePath();
+    if (!watcher.directories().contains(dirPath)) {
+        watcher.addPath(dirPath);
+    }
+    if (!watcher.files().contains(filePath) && QFile::exists(filePath)) {
+        watcher.addPath(filePath);
+    }
+}
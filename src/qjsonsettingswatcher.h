@@ -0,0 +1,45 @@
+// Copyright (C) 2025 Stdware Collections (https://www.github.com/stdware)
+// SPDX-License-Identifier: MIT
+
+#ifndef QJSONSETTINGSWATCHER_H
+#define QJSONSETTINGSWATCHER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QSettings>
+#include <QtCore/QFileSystemWatcher>
+
+// Watches a JSON settings file and reports the keys that changed when another process rewrites
+// it. Only the top-level branches whose content hash changed are decoded again, a branch that
+// fails to decode keeps its last values.
+class QJsonSettingsWatcher : public QObject {
+    Q_OBJECT
+public:
+    explicit QJsonSettingsWatcher(const QString &path, QObject *parent = nullptr);
+    ~QJsonSettingsWatcher() override;
+
+    QString path() const;
+
+    // The settings decoded from the last successful load
+    QSettings::SettingsMap settings() const;
+
+    // Re-reads the file, returns the changed keys and emits "changed" if there are any
+    QStringList reload();
+
+Q_SIGNALS:
+    void changed(const QStringList &keys);
+
+private:
+    struct Branch {
+        size_t hash = 0;
+        QSettings::SettingsMap settings;
+    };
+
+    void updateWatchedPaths();
+
+    QString filePath;
+    QFileSystemWatcher watcher;
+    QHash<QString, Branch> branches;
+};
+
+#endif // QJSONSETTINGSWATCHER_H
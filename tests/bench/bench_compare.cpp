@@ -0,0 +1,107 @@
+#include <cstdio>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+
+static bool readResults(const QString &path, QJsonObject &out) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        return false;
+    }
+    out = doc.object().value(QStringLiteral("scenarios")).toObject();
+    return true;
+}
+
+// Compares one metric, a baseline without a number only prints the result and counts it as
+// missing. Returns false on a regression beyond the tolerance.
+static bool compareMetric(const QString &name, const QJsonValue &baseline, const QJsonValue &result,
+                          double tolerance, int &compared, int &missing) {
+    const double actual = result.toDouble(-1);
+    if (actual < 0) {
+        std::printf("%-32s %14s %14s  n/a\n", qPrintable(name), "", "");
+        return true;
+    }
+    if (!baseline.isDouble()) {
+        std::printf("%-32s %14s %14.0f  NO BASELINE\n", qPrintable(name), "", actual);
+        ++missing;
+        return true;
+    }
+    ++compared;
+
+    const double expected = baseline.toDouble();
+    const double change = expected > 0 ? actual / expected - 1 : (actual > 0 ? 1 : 0);
+    const bool regressed = change > tolerance;
+    std::printf("%-32s %14.0f %14.0f %+6.1f%%%s\n", qPrintable(name), expected, actual,
+                change * 100, regressed ? "  REGRESSION" : "");
+    return !regressed;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Compares benchmark results with a baseline, exits with 1 if any scenario got slower or "
+        "allocates more than the tolerance allows, and with 3 if the baseline has no numbers."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("baseline"), QStringLiteral("Baseline file."));
+    parser.addPositionalArgument(QStringLiteral("results"), QStringLiteral("Results file."));
+    parser.addOption({QStringLiteral("tolerance"),
+                      QStringLiteral("Allowed relative increase of a metric."),
+                      QStringLiteral("ratio"), QStringLiteral("0.1")});
+    parser.process(a);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2) {
+        parser.showHelp(2);
+    }
+    const double tolerance = parser.value(QStringLiteral("tolerance")).toDouble();
+
+    QJsonObject baseline;
+    QJsonObject results;
+    if (!readResults(args[0], baseline) || !readResults(args[1], results)) {
+        std::fprintf(stderr, "FAIL: can't read %s or %s\n", qPrintable(args[0]),
+                     qPrintable(args[1]));
+        return 2;
+    }
+
+    std::printf("%-32s %14s %14s %7s\n", "metric", "baseline", "result", "change");
+    bool ok = true;
+    int compared = 0;
+    int missing = 0;
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        const QJsonObject expected = baseline.value(it.key()).toObject();
+        const QJsonObject actual = it.value().toObject();
+        for (const auto &op : {QStringLiteral("read"), QStringLiteral("write")}) {
+            const QJsonObject expectedOp = expected.value(op).toObject();
+            const QJsonObject actualOp = actual.value(op).toObject();
+            for (const auto &metric : {QStringLiteral("nsPerOp"), QStringLiteral("allocations")}) {
+                ok &= compareMetric(it.key() + QLatin1Char('/') + op + QLatin1Char('/') + metric,
+                                    expectedOp.value(metric), actualOp.value(metric), tolerance,
+                                    compared, missing);
+            }
+        }
+    }
+
+    // A baseline without numbers can't catch anything, which mustn't pass for a clean run
+    if (compared == 0) {
+        std::fprintf(stderr, "FAIL: %s has no numbers to compare with, record it with "
+                             "bench_qjsonsettings --output\n",
+                     qPrintable(args[0]));
+        return 3;
+    }
+    if (missing > 0) {
+        std::fprintf(stderr, "WARNING: %d metrics have no baseline and weren't checked\n",
+                     missing);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QBuffer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QRect>
+#include <QtCore/QPoint>
+#include <QtCore/QSize>
+
+#include <qjsonsettings.h>
+
+// Allocations are counted by interposing the C allocator, which also serves operator new and
+// QtCore's containers. Only possible with glibc, elsewhere the count is reported as -1.
+#if defined(__GLIBC__)
+static std::atomic<qint64> allocationCount{0};
+
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+
+    void *malloc(size_t size) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+}
+
+static inline qint64 allocations() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+#else
+static inline qint64 allocations() {
+    return -1;
+}
+#endif
+
+// SCENARIOS
+// Shapes seen in production settings files, generated deterministically so that every run
+// measures the same input
+struct Scenario {
+    QString name;
+    QSettings::SettingsMap settings;
+};
+
+// Many keys in a single group with primitive values
+static QSettings::SettingsMap flatSettings() {
+    QSettings::SettingsMap settings;
+    for (int i = 0; i < 10000; ++i) {
+        const QString key = QStringLiteral("key%1").arg(i, 5, 10, QLatin1Char('0'));
+        switch (i % 4) {
+            case 0:
+                settings.insert(key, i);
+                break;
+            case 1:
+                settings.insert(key, QStringLiteral("value-%1").arg(i));
+                break;
+            case 2:
+                settings.insert(key, i % 3 == 0);
+                break;
+            default:
+                settings.insert(key, i / 7.0);
+                break;
+        }
+    }
+    return settings;
+}
+
+// Many groups of moderate size
+static QSettings::SettingsMap wideSettings() {
+    QSettings::SettingsMap settings;
+    for (int i = 0; i < 100; ++i) {
+        for (int j = 0; j < 100; ++j) {
+            settings.insert(QStringLiteral("group%1/key%2")
+                                .arg(i, 3, 10, QLatin1Char('0'))
+                                .arg(j, 3, 10, QLatin1Char('0')),
+                            i * 100 + j);
+        }
+    }
+    return settings;
+}
+
+// UI state made of tagged geometry values
+static QSettings::SettingsMap geometrySettings() {
+    QSettings::SettingsMap settings;
+    for (int i = 0; i < 2000; ++i) {
+        const QString group = QStringLiteral("windows/%1/").arg(i, 4, 10, QLatin1Char('0'));
+        settings.insert(group + QStringLiteral("geometry"), QRect(i, i * 2, 800, 600));
+        settings.insert(group + QStringLiteral("position"), QPoint(i, -i));
+        settings.insert(group + QStringLiteral("size"), QSize(800, 600));
+        settings.insert(group + QStringLiteral("visible"), i % 2 == 0);
+    }
+    return settings;
+}
+
+// Long chains of nested groups
+static QSettings::SettingsMap deepSettings() {
+    QSettings::SettingsMap settings;
+    for (int i = 0; i < 100; ++i) {
+        QString key = QStringLiteral("chain%1").arg(i, 3, 10, QLatin1Char('0'));
+        for (int depth = 0; depth < 64; ++depth) {
+            key += QStringLiteral("/level%1").arg(depth);
+            settings.insert(key + QStringLiteral("/value"), depth);
+        }
+    }
+    return settings;
+}
+
+// Values made of deeply nested lists
+static QSettings::SettingsMap nestedSettings() {
+    QSettings::SettingsMap settings;
+    for (int i = 0; i < 100; ++i) {
+        QVariant value = i;
+        for (int depth = 0; depth < 200; ++depth) {
+            value = QVariantList({value, depth});
+        }
+        settings.insert(QStringLiteral("nested%1").arg(i, 3, 10, QLatin1Char('0')), value);
+    }
+    return settings;
+}
+
+static QList<Scenario> scenarios() {
+    return {
+        {QStringLiteral("flat"),     flatSettings()    },
+        {QStringLiteral("wide"),     wideSettings()    },
+        {QStringLiteral("geometry"), geometrySettings()},
+        {QStringLiteral("deep"),     deepSettings()    },
+        {QStringLiteral("nested"),   nestedSettings()  },
+    };
+}
+
+// RUNNER
+struct Sample {
+    qint64 nsecs;
+    qint64 allocations;
+};
+
+// Median time and allocations per operation after one warm-up run
+template <class F>
+static QJsonObject measure(int iterations, qint64 bytes, F &&op) {
+    if (!op()) {
+        return {};
+    }
+
+    QList<Sample> samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        const qint64 allocated = allocations();
+        timer.start();
+        op();
+        const qint64 nsecs = timer.nsecsElapsed();
+        samples.append({nsecs, allocations() < 0 ? -1 : allocations() - allocated});
+    }
+    std::sort(samples.begin(), samples.end(),
+              [](const Sample &a, const Sample &b) { return a.nsecs < b.nsecs; });
+    const Sample &median = samples[samples.size() / 2];
+
+    QJsonObject result;
+    result.insert(QStringLiteral("nsPerOp"), median.nsecs);
+    result.insert(QStringLiteral("mbPerSec"),
+                  double(bytes) / (1024 * 1024) / (qMax<qint64>(median.nsecs, 1) / 1e9));
+    result.insert(QStringLiteral("allocations"), median.allocations);
+    return result;
+}
+
+static bool runScenario(const Scenario &scenario, int iterations, QJsonObject &result) {
+    QByteArray data;
+    {
+        QBuffer buffer(&data);
+        if (!buffer.open(QIODevice::WriteOnly) ||
+            !QJsonSettings::write(buffer, scenario.settings)) {
+            return false;
+        }
+    }
+
+    const QJsonObject write = measure(iterations, data.size(), [&]() {
+        QByteArray out;
+        QBuffer buffer(&out);
+        return buffer.open(QIODevice::WriteOnly) && QJsonSettings::write(buffer, scenario.settings);
+    });
+    const QJsonObject read = measure(iterations, data.size(), [&]() {
+        QBuffer buffer;
+        buffer.setData(data);
+        QSettings::SettingsMap out;
+        return buffer.open(QIODevice::ReadOnly) && QJsonSettings::read(buffer, out);
+    });
+    if (write.isEmpty() || read.isEmpty()) {
+        return false;
+    }
+
+    result.insert(QStringLiteral("keys"), scenario.settings.size());
+    result.insert(QStringLiteral("bytes"), data.size());
+    result.insert(QStringLiteral("read"), read);
+    result.insert(QStringLiteral("write"), write);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Measures read and write time and allocations per scenario, printed as JSON in the "
+        "format of the baseline."));
+    parser.addHelpOption();
+    parser.addOption({QStringLiteral("iterations"), QStringLiteral("Number of iterations."),
+                      QStringLiteral("count"), QStringLiteral("20")});
+    parser.addOption({QStringLiteral("scenario"), QStringLiteral("Only run this scenario."),
+                      QStringLiteral("name")});
+    parser.addOption({QStringLiteral("output"),
+                      QStringLiteral("Write the results to a file instead of stdout."),
+                      QStringLiteral("file")});
+    parser.process(a);
+
+    const int iterations = qMax(1, parser.value(QStringLiteral("iterations")).toInt());
+    const QString only = parser.value(QStringLiteral("scenario"));
+
+    QJsonObject results;
+    for (const auto &scenario : scenarios()) {
+        if (!only.isEmpty() && scenario.name != only) {
+            continue;
+        }
+        QJsonObject result;
+        if (!runScenario(scenario, iterations, result)) {
+            std::fprintf(stderr, "FAIL: %s\n", qPrintable(scenario.name));
+            return 1;
+        }
+        results.insert(scenario.name, result);
+    }
+
+    QJsonObject root;
+    root.insert(QStringLiteral("version"), 1);
+    root.insert(QStringLiteral("qt"), QString::fromLatin1(qVersion()));
+    root.insert(QStringLiteral("iterations"), iterations);
+    root.insert(QStringLiteral("scenarios"), results);
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (parser.isSet(QStringLiteral("output"))) {
+        QFile file(parser.value(QStringLiteral("output")));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            std::fprintf(stderr, "FAIL: can't write %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+        return 0;
+    }
+    std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    return 0;
+}
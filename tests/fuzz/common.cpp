@@ -0,0 +1,537 @@
+#include "common.h"
+
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+#include <QtCore/QBuffer>
+#include <QtCore/QRect>
+#include <QtCore/QLine>
+#include <QtCore/QPoint>
+#include <QtCore/QSize>
+#include <QtCore/QDateTime>
+#include <QtCore/QUuid>
+#include <QtCore/QUrl>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonDocument>
+#include <QtGui/QColor>
+
+#include <qjsonsettingsstore.h>
+
+namespace Differential {
+
+    // GENERATOR
+    static const QStringList kKeyNames = {
+        "a", "b", "c", "foo", "bar", "long_key_name_with_suffix", "@at", "$value", "$type",
+        QString::fromUtf8("\xC3\xA9\xE4\xB8\xAD"),
+    };
+
+    static const QStringList kStrings = {
+        "",
+        "Hello, world!",
+        "@",
+        "@@double",
+        "@Variant(",
+        "@ByteArray(abc)",
+        "@Invalid()",
+        "/a/b/",
+        "\"quoted\" \\ back\\slash\n\t",
+        QString::fromUtf8("\xF0\x9F\x98\x80 \xE4\xB8\xAD\xE6\x96\x87"),
+        QString(QChar::Null),
+    };
+
+    static int randomInt(QRandomGenerator &rng) {
+        return int(rng.generate());
+    }
+
+    static double randomDouble(QRandomGenerator &rng) {
+        double num = rng.generateDouble() * std::pow(10.0, double(rng.bounded(-10, 11)));
+        return rng.bounded(2) ? num : -num;
+    }
+
+    static qlonglong randomLongLong(QRandomGenerator &rng) {
+        // Integers around the threshold above which they're stored as strings
+        static const qlonglong kEdges[] = {
+            2LL << 50,
+            (2LL << 50) + 1,
+            (2LL << 50) - 1,
+            -(2LL << 50),
+            -(2LL << 50) - 1,
+            -(2LL << 50) + 1,
+            0,
+            std::numeric_limits<qlonglong>::max(),
+            std::numeric_limits<qlonglong>::lowest(),
+        };
+        if (rng.bounded(2)) {
+            return kEdges[rng.bounded(int(std::size(kEdges)))];
+        }
+        return qlonglong(rng.generate64());
+    }
+
+    static qulonglong randomULongLong(QRandomGenerator &rng) {
+        static const qulonglong kEdges[] = {
+            2ULL << 50,
+            (2ULL << 50) + 1,
+            (2ULL << 50) - 1,
+            0,
+            std::numeric_limits<qulonglong>::max(),
+        };
+        if (rng.bounded(2)) {
+            return kEdges[rng.bounded(int(std::size(kEdges)))];
+        }
+        return rng.generate64();
+    }
+
+    static QString randomString(QRandomGenerator &rng) {
+        if (rng.bounded(2)) {
+            return kStrings[rng.bounded(int(kStrings.size()))];
+        }
+        QString result;
+        const int size = rng.bounded(40);
+        for (int i = 0; i < size; ++i) {
+            result.append(QChar(char16_t(rng.bounded(0x20, 0xD800))));
+        }
+        return result;
+    }
+
+    static QJsonValue randomJson(QRandomGenerator &rng, int depth) {
+        switch (rng.bounded(depth > 2 ? 4 : 6)) {
+            case 0:
+                return bool(rng.bounded(2));
+            case 1:
+                return randomDouble(rng);
+            case 2:
+                return randomString(rng);
+            case 3:
+                return QJsonValue::Null;
+            case 4: {
+                QJsonArray arr;
+                const int size = rng.bounded(4);
+                for (int i = 0; i < size; ++i) {
+                    arr.append(randomJson(rng, depth + 1));
+                }
+                return arr;
+            }
+            default: {
+                QJsonObject obj;
+                const int size = rng.bounded(4);
+                for (int i = 0; i < size; ++i) {
+                    obj.insert(kKeyNames[rng.bounded(int(kKeyNames.size()))],
+                               randomJson(rng, depth + 1));
+                }
+                return obj;
+            }
+        }
+    }
+
+    static QVariant randomValue(QRandomGenerator &rng, int depth) {
+        switch (rng.bounded(depth > 2 ? 39 : 43)) {
+            // Primitive types
+            case 0:
+                return bool(rng.bounded(2));
+            case 1:
+                return randomInt(rng);
+            case 2:
+                return uint(rng.generate());
+            case 3:
+                return randomDouble(rng);
+            case 4:
+                return QVariant::fromValue(short(rng.generate()));
+            case 5:
+                return QVariant::fromValue(ushort(rng.generate()));
+            case 6:
+                return float(randomDouble(rng));
+            case 7:
+                return randomLongLong(rng);
+            case 8:
+                return randomULongLong(rng);
+
+            // Simple json types
+            case 9:
+            case 10:
+                return randomString(rng);
+            case 11:
+                return randomJson(rng, 2).toArray();
+
+            // String list and byte array
+            case 12: {
+                QStringList result;
+                const int size = rng.bounded(5);
+                for (int i = 0; i < size; ++i) {
+                    result.append(randomString(rng));
+                }
+                return result;
+            }
+            case 13: {
+                QByteArray result;
+                const int size = rng.bounded(32);
+                for (int i = 0; i < size; ++i) {
+                    result.append(char(rng.bounded(256)));
+                }
+                return result;
+            }
+
+            // Simple structure types
+            case 14:
+                return QRect(randomInt(rng), randomInt(rng), randomInt(rng), randomInt(rng));
+            case 15:
+                return QRectF(randomDouble(rng), randomDouble(rng), randomDouble(rng),
+                              randomDouble(rng));
+            case 16:
+                return QSize(randomInt(rng), randomInt(rng));
+            case 17:
+                return QSizeF(randomDouble(rng), randomDouble(rng));
+            case 18:
+                return QPoint(randomInt(rng), randomInt(rng));
+            case 19:
+                return QPointF(randomDouble(rng), randomDouble(rng));
+            case 20:
+                return QLine(randomInt(rng), randomInt(rng), randomInt(rng), randomInt(rng));
+            case 21:
+                return QLineF(randomDouble(rng), randomDouble(rng), randomDouble(rng),
+                              randomDouble(rng));
+
+            // Complex json types
+            case 22:
+                return QVariant::fromValue(randomJson(rng, 0));
+            case 23: {
+                QJsonValue value;
+                do {
+                    value = randomJson(rng, 0);
+                } while (!value.isObject());
+                return value.toObject();
+            }
+            case 24: {
+                const auto &value = randomJson(rng, 0);
+                if (value.isObject()) {
+                    return QJsonDocument(value.toObject());
+                }
+                if (value.isArray()) {
+                    return QJsonDocument(value.toArray());
+                }
+                return QJsonDocument();
+            }
+
+            // Date and time types
+            case 25: {
+                const auto &dt = QDateTime::fromMSecsSinceEpoch(qint64(rng.bounded(1LL << 45)));
+                return rng.bounded(2) ? dt.toUTC() : dt;
+            }
+            case 26:
+                return QDate::fromJulianDay(rng.bounded(1000000, 4000000));
+            case 27:
+                return QTime::fromMSecsSinceStartOfDay(rng.bounded(86400000));
+
+            // Other common types
+            case 28: {
+                QByteArray bytes(16, Qt::Uninitialized);
+                for (auto &c : bytes) {
+                    c = char(rng.bounded(256));
+                }
+                return QUuid::fromRfc4122(bytes);
+            }
+            case 29:
+                return QUrl(QStringLiteral("https://example.com/") +
+                            QString::number(rng.generate()) + QStringLiteral("?q=a%20b"));
+            case 30:
+                return QColor(rng.bounded(256), rng.bounded(256), rng.bounded(256),
+                              rng.bounded(2) ? 255 : rng.bounded(256));
+
+            // Typed homogeneous arrays
+            case 31: {
+                QList<double> result;
+                const int size = rng.bounded(16);
+                for (int i = 0; i < size; ++i) {
+                    result.append(randomDouble(rng));
+                }
+                return QVariant::fromValue(result);
+            }
+            case 32: {
+                QList<int> result;
+                const int size = rng.bounded(16);
+                for (int i = 0; i < size; ++i) {
+                    result.append(randomInt(rng));
+                }
+                return QVariant::fromValue(result);
+            }
+
+            // Unknown type
+            case 33:
+                return QVariant();
+
+            // Repeat common types to keep them frequent at deeper levels
+            case 34:
+            case 35:
+                return randomString(rng);
+            case 36:
+            case 37:
+                return randomDouble(rng);
+            case 38:
+                return bool(rng.bounded(2));
+
+            // Variant container types
+            case 39:
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+                return QVariant::fromValue(
+                    QVariantPair(randomValue(rng, depth + 1), randomValue(rng, depth + 1)));
+#else
+                return QVariantList({randomValue(rng, depth + 1), randomValue(rng, depth + 1)});
+#endif
+            case 40: {
+                QVariantList result;
+                const int size = rng.bounded(5);
+                for (int i = 0; i < size; ++i) {
+                    result.append(randomValue(rng, depth + 1));
+                }
+                return result;
+            }
+            case 41: {
+                QVariantMap result;
+                const int size = rng.bounded(5);
+                for (int i = 0; i < size; ++i) {
+                    result.insert(kKeyNames[rng.bounded(int(kKeyNames.size()))],
+                                  randomValue(rng, depth + 1));
+                }
+                return result;
+            }
+            default: {
+                QVariantHash result;
+                const int size = rng.bounded(5);
+                for (int i = 0; i < size; ++i) {
+                    result.insert(kKeyNames[rng.bounded(int(kKeyNames.size()))],
+                                  randomValue(rng, depth + 1));
+                }
+                return result;
+            }
+        }
+    }
+
+    QSettings::SettingsMap randomSettings(QRandomGenerator &rng, int keyCount) {
+        QSettings::SettingsMap result;
+        for (int i = 0; i < keyCount; ++i) {
+            QStringList names;
+            const int depth = rng.bounded(1, 6);
+            for (int j = 0; j < depth; ++j) {
+                names.append(kKeyNames[rng.bounded(int(kKeyNames.size()))]);
+            }
+
+            // Repeat earlier values now and then, generated configs are often repetitive
+            if (!result.isEmpty() && rng.bounded(8) == 0) {
+                auto it = result.constBegin();
+                std::advance(it, rng.bounded(int(result.size())));
+                result.insert(names.join(QLatin1Char('/')), it.value());
+                continue;
+            }
+            result.insert(names.join(QLatin1Char('/')), randomValue(rng, 0));
+        }
+        return result;
+    }
+
+    // REFERENCE
+    bool referenceRead(const QByteArray &data, QSettings::SettingsMap &settings) {
+        QBuffer buffer;
+        buffer.setData(data);
+        if (!buffer.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        return QJsonSettings::read(buffer, settings);
+    }
+
+    bool referenceWrite(const QSettings::SettingsMap &settings, QByteArray &data) {
+        QBuffer buffer(&data);
+        if (!buffer.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        return QJsonSettings::write(buffer, settings);
+    }
+
+    // FAST PATHS
+    QList<FastPath> fastPaths() {
+        QList<FastPath> result;
+
+        // Global string interning
+        {
+            FastPath path;
+            path.name = QStringLiteral("interning");
+            path.read = [](const QByteArray &data, const QSettings::SettingsMap &reference,
+                           QSettings::SettingsMap &settings) {
+                Q_UNUSED(reference)
+                QJsonSettings::setStringInterning(true);
+                bool ok = referenceRead(data, settings);
+                QJsonSettings::setStringInterning(false);
+                QJsonSettings::clearInternedStrings();
+                return ok;
+            };
+            result.append(path);
+        }
+
+        // Schema built from the types produced by the reference read
+        {
+            FastPath path;
+            path.name = QStringLiteral("schema");
+            path.read = [](const QByteArray &data, const QSettings::SettingsMap &reference,
+                           QSettings::SettingsMap &settings) {
+                QJsonSettingsSchema schema;
+                for (auto it = reference.begin(); it != reference.end(); ++it) {
+                    schema.insert(it.key(), it.value().userType());
+                }
+                schema.setUnknownKeyPolicy(QJsonSettingsSchema::RejectUnknownKeys);
+
+                QBuffer buffer;
+                buffer.setData(data);
+                if (!buffer.open(QIODevice::ReadOnly)) {
+                    return false;
+                }
+                return QJsonSettings::read(buffer, settings, schema);
+            };
+            result.append(path);
+        }
+
+        // Round trip through a file written with value references, written again without them
+        {
+            FastPath path;
+            path.name = QStringLiteral("references");
+            path.read = [](const QByteArray &data, const QSettings::SettingsMap &reference,
+                           QSettings::SettingsMap &settings) {
+                Q_UNUSED(reference)
+                return referenceRead(data, settings);
+            };
+            path.write = [](const QSettings::SettingsMap &settings, QByteArray &data) {
+                QJsonSettings::setValueReferences(true);
+                QByteArray written;
+                bool ok = referenceWrite(settings, written);
+                QJsonSettings::setValueReferences(false);
+
+                QSettings::SettingsMap expanded;
+                return ok && referenceRead(written, expanded) && referenceWrite(expanded, data);
+            };
+            result.append(path);
+        }
+
+        // Round trip through a file written with compact tags, written again with the full ones
+        {
+            FastPath path;
+            path.name = QStringLiteral("compact");
+            path.read = [](const QByteArray &data, const QSettings::SettingsMap &reference,
+                           QSettings::SettingsMap &settings) {
+                Q_UNUSED(reference)
+                return referenceRead(data, settings);
+            };
+            path.write = [](const QSettings::SettingsMap &settings, QByteArray &data) {
+                QJsonSettings::setCompactTags(true);
+                QByteArray written;
+                bool ok = referenceWrite(settings, written);
+                QJsonSettings::setCompactTags(false);
+
+                QSettings::SettingsMap decoded;
+                return ok && referenceRead(written, decoded) && referenceWrite(decoded, data);
+            };
+            result.append(path);
+        }
+
+        // Settings tree loaded and saved without the flat map
+        {
+            FastPath path;
+            path.name = QStringLiteral("store");
+            path.read = [](const QByteArray &data, const QSettings::SettingsMap &reference,
+                           QSettings::SettingsMap &settings) {
+                Q_UNUSED(reference)
+                QBuffer buffer;
+                buffer.setData(data);
+                if (!buffer.open(QIODevice::ReadOnly)) {
+                    return false;
+                }
+
+                QJsonSettingsStore store;
+                if (!store.load(buffer)) {
+                    return false;
+                }
+                settings = store.toSettingsMap();
+                return true;
+            };
+            path.write = [](const QSettings::SettingsMap &settings, QByteArray &data) {
+                QJsonSettingsStore store;
+                for (auto it = settings.begin(); it != settings.end(); ++it) {
+                    store.setValue(it.key(), it.value());
+                }
+
+                QBuffer buffer(&data);
+                if (!buffer.open(QIODevice::WriteOnly)) {
+                    return false;
+                }
+                return store.save(buffer);
+            };
+            result.append(path);
+        }
+
+        return result;
+    }
+
+    // CHECKS
+    QString compareSettings(const QSettings::SettingsMap &expected,
+                            const QSettings::SettingsMap &actual) {
+        if (expected.size() != actual.size()) {
+            return QStringLiteral("size mismatch: %1 != %2")
+                .arg(expected.size())
+                .arg(actual.size());
+        }
+        for (auto it = expected.begin(), it1 = actual.begin(); it != expected.end(); ++it, ++it1) {
+            if (it.key() != it1.key()) {
+                return QStringLiteral("key mismatch: %1 != %2").arg(it.key(), it1.key());
+            }
+            if (it.value() != it1.value() || it.value().userType() != it1.value().userType()) {
+                return QStringLiteral("value mismatch at %1: %2 != %3")
+                    .arg(it.key(), QLatin1String(it.value().typeName()),
+                         QLatin1String(it1.value().typeName()));
+            }
+        }
+        return {};
+    }
+
+    QString checkRead(const QByteArray &data) {
+        QSettings::SettingsMap reference;
+        const bool referenceOk = referenceRead(data, reference);
+
+        for (const auto &path : fastPaths()) {
+            QSettings::SettingsMap settings;
+            const bool ok = path.read(data, reference, settings);
+            if (ok != referenceOk) {
+                return QStringLiteral("%1: read returned %2, reference returned %3")
+                    .arg(path.name)
+                    .arg(ok)
+                    .arg(referenceOk);
+            }
+            if (!ok) {
+                continue;
+            }
+            const auto &message = compareSettings(reference, settings);
+            if (!message.isEmpty()) {
+                return path.name + QStringLiteral(": ") + message;
+            }
+        }
+        return {};
+    }
+
+    QString checkWrite(const QSettings::SettingsMap &settings) {
+        QByteArray reference;
+        if (!referenceWrite(settings, reference)) {
+            return QStringLiteral("reference write failed");
+        }
+
+        for (const auto &path : fastPaths()) {
+            if (!path.write) {
+                continue;
+            }
+            QByteArray data;
+            if (!path.write(settings, data)) {
+                return path.name + QStringLiteral(": write failed");
+            }
+            if (data != reference) {
+                return path.name + QStringLiteral(": output bytes differ");
+            }
+        }
+        return checkRead(reference);
+    }
+
+}
@@ -0,0 +1,54 @@
+// Copyright (C) 2025 Stdware Collections (https://www.github.com/stdware)
+// SPDX-License-Identifier: MIT
+
+#ifndef QJSONSETTINGS_FUZZ_COMMON_H
+#define QJSONSETTINGS_FUZZ_COMMON_H
+
+#include <functional>
+
+#include <QtCore/QList>
+#include <QtCore/QRandomGenerator>
+
+#include <qjsonsettings.h>
+
+// Differential checks of the optimized read/write paths against the reference path, which is
+// QJsonSettings::read/write with every option at its default
+namespace Differential {
+
+    // Settings with nested and colliding keys, holding values of every type handled by the
+    // writer, including integers around the double precision threshold
+    QSettings::SettingsMap randomSettings(QRandomGenerator &rng, int keyCount);
+
+    bool referenceRead(const QByteArray &data, QSettings::SettingsMap &settings);
+    bool referenceWrite(const QSettings::SettingsMap &settings, QByteArray &data);
+
+    struct FastPath {
+        QString name;
+
+        // The result of the reference read is passed for paths that derive their options from
+        // the content, e.g. a schema
+        std::function<bool(const QByteArray &data, const QSettings::SettingsMap &reference,
+                           QSettings::SettingsMap &settings)>
+            read;
+
+        // Empty if the path doesn't have a write side
+        std::function<bool(const QSettings::SettingsMap &settings, QByteArray &data)> write;
+    };
+
+    QList<FastPath> fastPaths();
+
+    // Returns an empty string if the settings are identical, otherwise describes the first
+    // difference
+    QString compareSettings(const QSettings::SettingsMap &expected,
+                            const QSettings::SettingsMap &actual);
+
+    // Reads the data with every path, returns the first mismatch or an empty string
+    QString checkRead(const QByteArray &data);
+
+    // Writes the settings with every path and reads them back, returns the first mismatch or an
+    // empty string
+    QString checkWrite(const QSettings::SettingsMap &settings);
+
+}
+
+#endif // QJSONSETTINGS_FUZZ_COMMON_H
@@ -0,0 +1,45 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <QtCore/QFile>
+
+#include "common.h"
+
+// Reads arbitrary input with every path, and if it's accepted, checks that writing the result
+// back is identical between the paths as well
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    const auto &input =
+        QByteArray::fromRawData(reinterpret_cast<const char *>(data), qsizetype(size));
+
+    auto message = Differential::checkRead(input);
+    if (message.isEmpty()) {
+        QSettings::SettingsMap settings;
+        if (Differential::referenceRead(input, settings)) {
+            message = Differential::checkWrite(settings);
+        }
+    }
+    if (!message.isEmpty()) {
+        std::fprintf(stderr, "%s\n", qPrintable(message));
+        std::abort();
+    }
+    return 0;
+}
+
+#ifdef QJSONSETTINGS_FUZZ_STANDALONE
+// Replays the given inputs without libFuzzer, e.g. a corpus or crash files
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        QFile file(QString::fromLocal8Bit(argv[i]));
+        if (!file.open(QIODevice::ReadOnly)) {
+            std::fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+        const auto &data = file.readAll();
+        std::printf("Running %s\n", argv[i]);
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(data.constData()),
+                               size_t(data.size()));
+    }
+    return 0;
+}
+#endif
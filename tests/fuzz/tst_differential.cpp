@@ -0,0 +1,114 @@
+#include <cstdio>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QBuffer>
+
+#include "common.h"
+
+static int runDifferential(quint32 seed, int iterations, int keyCount) {
+    QRandomGenerator rng(seed);
+    for (int i = 0; i < iterations; ++i) {
+        const auto &settings = Differential::randomSettings(rng, keyCount);
+        const auto &message = Differential::checkWrite(settings);
+        if (!message.isEmpty()) {
+            std::fprintf(stderr, "FAIL: seed %u, iteration %d: %s\n", seed, i,
+                         qPrintable(message));
+            return 1;
+        }
+    }
+    std::printf("PASS: %d iterations, seed %u\n", iterations, seed);
+    return 0;
+}
+
+static void printThroughput(const QString &name, const char *op, qint64 bytes, int iterations,
+                            qint64 nsecs) {
+    const double secs = double(nsecs) / 1e9;
+    std::printf("%-12s %-6s %10.2f MB/s %10.2f ops/s\n", qPrintable(name), op,
+                double(bytes) * iterations / secs / (1024 * 1024), iterations / secs);
+}
+
+static int runThroughput(quint32 seed, int iterations, int keyCount) {
+    QRandomGenerator rng(seed);
+    const auto &settings = Differential::randomSettings(rng, keyCount);
+
+    QByteArray data;
+    if (!Differential::referenceWrite(settings, data)) {
+        std::fprintf(stderr, "FAIL: reference write failed\n");
+        return 1;
+    }
+    QSettings::SettingsMap reference;
+    if (!Differential::referenceRead(data, reference)) {
+        std::fprintf(stderr, "FAIL: reference read failed\n");
+        return 1;
+    }
+    std::printf("%d keys, %lld bytes, %d iterations\n", int(settings.size()),
+                qint64(data.size()), iterations);
+
+    QElapsedTimer timer;
+
+    // Reference
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        QByteArray out;
+        Differential::referenceWrite(settings, out);
+    }
+    printThroughput(QStringLiteral("reference"), "write", data.size(), iterations,
+                    timer.nsecsElapsed());
+
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        QSettings::SettingsMap out;
+        Differential::referenceRead(data, out);
+    }
+    printThroughput(QStringLiteral("reference"), "read", data.size(), iterations,
+                    timer.nsecsElapsed());
+
+    // Fast paths
+    for (const auto &path : Differential::fastPaths()) {
+        if (path.write) {
+            timer.start();
+            for (int i = 0; i < iterations; ++i) {
+                QByteArray out;
+                path.write(settings, out);
+            }
+            printThroughput(path.name, "write", data.size(), iterations, timer.nsecsElapsed());
+        }
+
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            QSettings::SettingsMap out;
+            path.read(data, reference, out);
+        }
+        printThroughput(path.name, "read", data.size(), iterations, timer.nsecsElapsed());
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Compares the fast read/write paths with the reference implementation."));
+    parser.addHelpOption();
+    parser.addOption({QStringLiteral("seed"), QStringLiteral("Random seed."),
+                      QStringLiteral("seed"), QStringLiteral("1")});
+    parser.addOption({QStringLiteral("iterations"), QStringLiteral("Number of iterations."),
+                      QStringLiteral("count"), QStringLiteral("200")});
+    parser.addOption({QStringLiteral("keys"), QStringLiteral("Number of keys per settings."),
+                      QStringLiteral("count"), QStringLiteral("64")});
+    parser.addOption(
+        {QStringLiteral("throughput"), QStringLiteral("Measure throughput instead of checking.")});
+    parser.process(a);
+
+    const quint32 seed = parser.value(QStringLiteral("seed")).toUInt();
+    const int iterations = parser.value(QStringLiteral("iterations")).toInt();
+    const int keyCount = parser.value(QStringLiteral("keys")).toInt();
+
+    if (parser.isSet(QStringLiteral("throughput"))) {
+        return runThroughput(seed, iterations, keyCount);
+    }
+    return runDifferential(seed, iterations, keyCount);
+}
@@ -7,12 +7,18 @@
 #include <QtCore/QPoint>
 #include <QtCore/QSize>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QBuffer>
 #include <QtCore/QVariant>
 #include <QtCore/QUuid>
 #include <QtGui/QColor>
 #include <QtTest/QtTest>
 
 #include <qjsonsettings.h>
+#include <qjsonsettingsoverlay.h>
+#include <qjsonsettingsstore.h>
+#include <qjsonsettingsthrottle.h>
+#include <qjsonsettingswatcher.h>
 
 static QSettings::Format format = QSettings::InvalidFormat;
 
@@ -160,15 +166,26 @@ private Q_SLOTS:
             {"pointF", QPointF(10.5, 20.5)},
             {"line", QLine(QPoint(10, 20), QPoint(30, 40))},
             {"lineF", QLineF(QPointF(10.5, 20.5), QPointF(30.5, 40.5))},
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
             {"variantPair", QVariant::fromValue(QVariantPair(123, "Hello, world!"))},
+#endif
             {"variantList", QVariantList({"foo", 123, true})},
             {"variantMap", QVariantMap({{"foo", "bar"}, {"baz", 123}})},
             {"variantHash", QVariantHash({{"foo", "bar"}, {"baz", 123}})},
+            {"doubleList", QVariant::fromValue(QList<double>({1.5, -2.25, 1e10}))},
+            {"intList", QVariant::fromValue(QList<int>({1, -2, 3}))},
             {"jsonValue", QJsonValue(123)},
             {"jsonObject", QJsonObject({{"foo", "bar"}, {"baz", 123}})},
             {"jsonDocument", QJsonDocument(QJsonObject({{"foo", "bar"}, {"baz", 123}}))},
             {"dateTime", QDateTime::currentDateTime()},
+            {"dateTimeUtc", QDateTime::currentDateTimeUtc()},
+            {"date", QDate(2025, 1, 31)},
+            {"time", QTime(12, 34, 56, 789)},
+            {"uuid", QUuid::createUuid()},
+            {"url", QUrl("https://example.com/a%20b?c=d#e")},
             {"color", QColor(255, 255, 255)},
+            {"colorAlpha", QColor(1, 2, 3, 4)},
+            {"colorHsv", QColor::fromHsv(120, 100, 50)},
             {"invalid", QVariant()},
         };
 
@@ -193,6 +210,69 @@ private Q_SLOTS:
         }
     }
 
+    void testNativeEncoding() {
+        // Strings in the encoding of QSettings' native formats, stored with a type of their own
+        const auto tagged = [](const char *data) {
+            return QJsonObject({
+                {QJsonSettings::reservedKey(QJsonSettings::ValueType), QMetaType::User},
+                {QJsonSettings::reservedKey(QJsonSettings::ValueData), data                 },
+            });
+        };
+        const QJsonObject obj = {
+            {"rect",     tagged("@Rect(10 -20 30 40)")},
+            {"size",     tagged("@Size(50 60)")       },
+            {"point",    tagged("@Point(+7 8)")       },
+            {"partial",  tagged("@Rect(1 2 3)")       },
+            {"overflow", tagged("@Point(1 2147483648)")},
+            {"bytes",    tagged("@ByteArray(abc)")    },
+            {"escaped",  tagged("@@Rect(1 2)")        },
+            {"invalid",  tagged("@Invalid()")         },
+        };
+
+        QBuffer buffer;
+        buffer.setData(QJsonDocument(obj).toJson());
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+        QSettings::SettingsMap result;
+        QVERIFY(QJsonSettings::read(buffer, result));
+        QCOMPARE(result.value("rect"), QVariant(QRect(10, -20, 30, 40)));
+        QCOMPARE(result.value("size"), QVariant(QSize(50, 60)));
+        QCOMPARE(result.value("point"), QVariant(QPoint(7, 8)));
+        QCOMPARE(result.value("partial"), QVariant("@Rect(1 2 3)"));
+        QCOMPARE(result.value("overflow"), QVariant(QPoint(1, 0)));
+        QCOMPARE(result.value("bytes"), QVariant(QByteArray("abc")));
+        QCOMPARE(result.value("escaped"), QVariant("@Rect(1 2)"));
+        QVERIFY(result.contains("invalid") && !result.value("invalid").isValid());
+
+        // Lists written as "@Variant" strings under their runtime type id, before they were
+        // tagged by type name
+        const QVariant list = QVariant::fromValue(QList<double>({1.5, 2.5}));
+        QByteArray stream;
+        {
+            QDataStream out(&stream, QIODevice::WriteOnly);
+            out.setVersion(QDataStream::Qt_4_0);
+            out << list;
+        }
+        const QJsonObject legacy = {
+            {"list",
+             QJsonObject({
+                 {QJsonSettings::reservedKey(QJsonSettings::ValueType),
+                  qMetaTypeId<QList<double>>()},
+                 {QJsonSettings::reservedKey(QJsonSettings::ValueData),
+                  QLatin1String("@Variant(") + QLatin1String(stream) + QLatin1Char(')')},
+             })},
+        };
+        QJsonSettingsSchema schema;
+        schema.insert<QList<double>>("list");
+        for (const auto &legacySchema : {QJsonSettingsSchema(), schema}) {
+            QBuffer legacyBuffer;
+            legacyBuffer.setData(QJsonDocument(legacy).toJson());
+            QVERIFY(legacyBuffer.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap legacyResult;
+            QVERIFY(QJsonSettings::read(legacyBuffer, legacyResult, legacySchema));
+            QCOMPARE(legacyResult.value("list"), list);
+        }
+    }
+
     void testModify() {
         const QList<QPair<QString, QVariant>> testPairs1 = {
             {"foo", "abc"},
@@ -236,6 +316,1022 @@ private Q_SLOTS:
             }
         }
     }
+
+    void testStringInterning() {
+        QJsonSettings::setStringInterning(true);
+
+        // Write settings
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("foo/bar", "short");
+            settings.setValue("foo/baz", QString(100, QLatin1Char('x')));
+            settings.setValue("qux", 123);
+            settings.sync();
+        }
+
+        refreshSettingsFiles();
+
+        // Read settings
+        {
+            QSettings settings(settingsPath, format);
+            QCOMPARE(settings.value("foo/bar").toString(), QString("short"));
+            QCOMPARE(settings.value("foo/baz").toString(), QString(100, QLatin1Char('x')));
+            QCOMPARE(settings.value("qux").toInt(), 123);
+        }
+
+        // Two reads share the storage of keys and short values, but not of long values
+        {
+            QSettings::SettingsMap maps[2];
+            for (auto &map : maps) {
+                QFile file(settingsPath);
+                QVERIFY(file.open(QIODevice::ReadOnly));
+                QVERIFY(QJsonSettings::read(file, map));
+            }
+            const auto first = maps[0].find("foo/bar");
+            const auto second = maps[1].find("foo/bar");
+            QCOMPARE(first.key().constData(), second.key().constData());
+            QCOMPARE(first.value().toString().constData(), second.value().toString().constData());
+            QVERIFY(maps[0].value("foo/baz").toString().constData() !=
+                    maps[1].value("foo/baz").toString().constData());
+
+            // The table is bounded, strings that the recent reads didn't meet are dropped
+            QJsonObject obj;
+            for (int i = 0; i < 20000; ++i) {
+                obj.insert(QString::number(i), i);
+            }
+            QBuffer buffer;
+            buffer.setData(QJsonDocument(obj).toJson());
+            QVERIFY(buffer.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap other;
+            QVERIFY(QJsonSettings::read(buffer, other));
+
+            QSettings::SettingsMap map;
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QVERIFY(QJsonSettings::read(file, map));
+            QCOMPARE(map, maps[0]);
+            QVERIFY(map.find("foo/bar").key().constData() != first.key().constData());
+        }
+
+        QJsonSettings::setStringInterning(false);
+        QJsonSettings::clearInternedStrings();
+    }
+
+    void testValueReferences() {
+        const QVariantList layout = {10, 20, 30, 40};
+        QJsonSettings::setValueReferences(true);
+
+        // Write settings
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("monitors/1/layout", layout);
+            settings.setValue("monitors/2/layout", layout);
+            settings.setValue("other/layout", layout);
+            settings.sync();
+        }
+
+        QJsonSettings::setValueReferences(false);
+
+        // Check the file
+        {
+            QJsonObject obj;
+            QVERIFY(readJson(settingsPath, obj));
+            const auto monitors = obj.value("monitors").toObject();
+            const auto second = monitors.value("2").toObject().value("layout").toObject();
+            QCOMPARE(second.value(QJsonSettings::reservedKey(QJsonSettings::ValueRef)),
+                     QJsonValue("monitors/1/layout"));
+
+            // References don't cross top-level groups
+            const auto other = obj.value("other").toObject().value("layout").toObject();
+            QVERIFY(other.contains(QJsonSettings::reservedKey(QJsonSettings::ValueType)));
+        }
+
+        refreshSettingsFiles();
+
+        // Read settings
+        {
+            QSettings settings(settingsPath, format);
+            QCOMPARE(settings.value("monitors/1/layout"), QVariant(layout));
+            QCOMPARE(settings.value("monitors/2/layout"), QVariant(layout));
+            QCOMPARE(settings.value("other/layout"), QVariant(layout));
+        }
+
+        // Objects that aren't valid references are groups like before
+        {
+            QBuffer buffer;
+            buffer.setData(R"({"schema": {"$ref": "#/definitions/foo"}})");
+            QVERIFY(buffer.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap settings;
+            QVERIFY(QJsonSettings::read(buffer, settings));
+            QCOMPARE(settings.value("schema/$ref"), QVariant("#/definitions/foo"));
+        }
+
+        // User keys named "$ref" are escaped, so they aren't read as references
+        {
+            const QSettings::SettingsMap settings = {
+                {"a/b",     "target"},
+                {"c/$ref",  "a/b"   },
+                {"d/$$ref", "a/b"   },
+            };
+            for (bool references : {false, true}) {
+                QJsonSettings::setValueReferences(references);
+                QBuffer buffer;
+                QVERIFY(buffer.open(QIODevice::WriteOnly));
+                QVERIFY(QJsonSettings::write(buffer, settings));
+                QJsonSettings::setValueReferences(false);
+
+                const QJsonObject obj = QJsonDocument::fromJson(buffer.data()).object();
+                QCOMPARE(obj.value("c").toObject().value("$$ref"), QJsonValue("a/b"));
+                QCOMPARE(obj.value("d").toObject().value("$$$ref"), QJsonValue("a/b"));
+
+                buffer.close();
+                QVERIFY(buffer.open(QIODevice::ReadOnly));
+                QSettings::SettingsMap result;
+                QVERIFY(QJsonSettings::read(buffer, result));
+                QCOMPARE(result, settings);
+            }
+        }
+    }
+
+    void testCompactTags() {
+        QJsonSettings::setCompactTags(true);
+
+        // Write settings
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("geometry", QRect(10, 20, 30, 40));
+            settings.setValue("list", QVariantList({QPoint(1, 2), "abc"}));
+            settings.sync();
+        }
+
+        QJsonSettings::setCompactTags(false);
+
+        // Check the file
+        {
+            QJsonObject obj;
+            QVERIFY(readJson(settingsPath, obj));
+            const auto geometry = obj.value("geometry").toObject();
+            QCOMPARE(geometry.size(), 2);
+            QCOMPARE(geometry.value(QJsonSettings::reservedKey(QJsonSettings::CompactValueType)),
+                     QJsonValue(QMetaType::QRect));
+            QVERIFY(geometry.contains(QJsonSettings::reservedKey(QJsonSettings::CompactValueData)));
+        }
+
+        refreshSettingsFiles();
+
+        // Read settings
+        {
+            QSettings settings(settingsPath, format);
+            QCOMPARE(settings.value("geometry"), QVariant(QRect(10, 20, 30, 40)));
+            QCOMPARE(settings.value("list"), QVariant(QVariantList({QPoint(1, 2), "abc"})));
+        }
+
+        // Objects that merely contain the compact keys are still groups
+        {
+            QBuffer buffer;
+            buffer.setData(R"({"group": {"$t": 1, "$d": true, "other": 2}})");
+            QVERIFY(buffer.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap result;
+            QVERIFY(QJsonSettings::read(buffer, result));
+            QCOMPARE(result.size(), 3);
+            QCOMPARE(result.value("group/other").toInt(), 2);
+        }
+
+        // User keys named "$t" and "$d" are escaped, so a group holding only them round-trips
+        {
+            const QSettings::SettingsMap settings = {
+                {"group/$t",  1.5   },
+                {"group/$d",  "abc" },
+                {"other/$$t", true  },
+                {"other/$$d", 2.5   },
+            };
+            QBuffer buffer;
+            QVERIFY(buffer.open(QIODevice::WriteOnly));
+            QVERIFY(QJsonSettings::write(buffer, settings));
+
+            const QJsonObject obj = QJsonDocument::fromJson(buffer.data()).object();
+            QCOMPARE(obj.value("group").toObject().keys(), QStringList({"$$d", "$$t"}));
+            QCOMPARE(obj.value("other").toObject().keys(), QStringList({"$$$d", "$$$t"}));
+
+            buffer.close();
+            QVERIFY(buffer.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap result;
+            QVERIFY(QJsonSettings::read(buffer, result));
+            QCOMPARE(result, settings);
+        }
+    }
+
+    void testSizeEstimates() {
+        static QVector<QJsonSettings::SizeEstimate> estimates;
+        estimates.clear();
+        QJsonSettings::setSizeEstimateHandler(
+            [](const QJsonSettings::SizeEstimate &estimate) { estimates.append(estimate); });
+
+        QSettings::SettingsMap settings;
+        for (int i = 0; i < 10; ++i) {
+            settings.insert("a/" + QString::number(i), i);
+        }
+        settings.insert("b/x/y", "abc");
+        settings.insert("top", true);
+
+        QBuffer buffer;
+        QVERIFY(buffer.open(QIODevice::ReadWrite));
+        QVERIFY(QJsonSettings::write(buffer, settings));
+        QVERIFY(buffer.seek(0));
+        QSettings::SettingsMap result;
+        QVERIFY(QJsonSettings::read(buffer, result));
+        QCOMPARE(result, settings);
+
+        QJsonSettings::setSizeEstimateHandler(nullptr);
+
+        // The node pools of a flat map are sized exactly, the input by the device size
+        const auto find = [](QJsonSettings::SizeEstimate::Buffer buffer) {
+            for (const auto &estimate : std::as_const(estimates)) {
+                if (estimate.buffer == buffer) {
+                    return estimate;
+                }
+            }
+            return QJsonSettings::SizeEstimate{buffer, -1, -1};
+        };
+        const auto leafs = find(QJsonSettings::SizeEstimate::LeafNodes);
+        QCOMPARE(leafs.estimated, qsizetype(12));
+        QCOMPARE(leafs.actual, qsizetype(12));
+        const auto branches = find(QJsonSettings::SizeEstimate::BranchNodes);
+        QCOMPARE(branches.estimated, qsizetype(4));
+        QCOMPARE(branches.actual, qsizetype(4));
+        const auto output = find(QJsonSettings::SizeEstimate::OutputData);
+        QCOMPARE(output.actual, qsizetype(buffer.size()));
+        const auto input = find(QJsonSettings::SizeEstimate::InputData);
+        QCOMPARE(input.estimated, qsizetype(buffer.size()));
+        QCOMPARE(input.actual, qsizetype(buffer.size()));
+
+        // The output is written into the estimated buffer directly, laid out as QJsonDocument does
+        QSettings::SettingsMap values = {
+            {"text", QString::fromUtf8("quote \" slash \\ tab \t bell \a \xc3\xa9 \xe4\xb8\xad "
+                                       "\xf0\x9f\x98\x80")},
+            {"numbers/small", 0.1},
+            {"numbers/large", 1e300},
+            {"numbers/integral", 3.0},
+            {"numbers/int64", qint64(1) << 60},
+            {"lists/empty", QVariantList()},
+            {"lists/nested", QVariantList{1, QVariantList{"a", true}, QVariantMap()}},
+        };
+        QBuffer output;
+        QVERIFY(output.open(QIODevice::ReadWrite));
+        QVERIFY(QJsonSettings::write(output, values));
+        const QJsonDocument doc = QJsonDocument::fromJson(output.data());
+        QVERIFY(doc.isObject());
+        QCOMPARE(output.data(), doc.toJson());
+    }
+
+    void testSnapshot() {
+        const QSettings::SettingsMap settings = {
+            {"foo/bar", 123                      },
+            {"rect",    QRect(10, 20, 30, 40)    },
+            {"list",    QVariantList({"abc", 1}) },
+        };
+        const QString snapshotPath = settingsPath + ".snapshot";
+        QJsonSettings::setSnapshots(true);
+
+        // Write settings
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            QVERIFY(QJsonSettings::write(file, settings));
+        }
+        QVERIFY(QFile::exists(snapshotPath));
+
+        // Read settings, from the snapshot
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap result;
+            QVERIFY(QJsonSettings::read(file, result));
+            QCOMPARE(result, settings);
+        }
+
+        // Corrupt a string in the payload, the snapshot fails its check and the file is parsed
+        {
+            QFile file(snapshotPath);
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QByteArray snapshot = file.readAll();
+            const QByteArray abc("\0a\0b\0c", 6);
+            const qsizetype index = snapshot.indexOf(abc);
+            QVERIFY(index > 0);
+            snapshot[index + 3] = 'x';
+            QVERIFY(file.seek(0));
+            QCOMPARE(file.write(snapshot), snapshot.size());
+        }
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap result;
+            QVERIFY(QJsonSettings::read(file, result));
+            QCOMPARE(result.value("list"), QVariant(QVariantList({"abc", 1})));
+        }
+
+        // Modify the file, the snapshot no longer matches
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            QVERIFY(file.write(R"({"foo": {"bar": 456}})") > 0);
+        }
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap result;
+            QVERIFY(QJsonSettings::read(file, result));
+            QCOMPARE(result.size(), 1);
+            QCOMPARE(result.value("foo/bar").toInt(), 456);
+        }
+
+        QJsonSettings::setSnapshots(false);
+        QVERIFY(QFile::remove(snapshotPath));
+    }
+
+    void testMaxDepth() {
+        const int orgMaxDepth = QJsonSettings::maxDepth();
+        QJsonSettings::setMaxDepth(3);
+
+        // Write settings deeper than the limit
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("a/b/c", 1);
+            settings.setValue("d/e/f/g/h", 2);
+            settings.sync();
+            QCOMPARE(settings.status(), QSettings::AccessError);
+        }
+
+        refreshSettingsFiles();
+
+        // Write settings within the limit
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("a/b/c", 1);
+            settings.setValue("d", QVariantList({QVariantList({1, 2})}));
+            settings.sync();
+            QCOMPARE(settings.status(), QSettings::NoError);
+        }
+
+        refreshSettingsFiles();
+
+        // Read settings
+        {
+            QSettings settings(settingsPath, format);
+            QCOMPARE(settings.value("a/b/c").toInt(), 1);
+            QCOMPARE(settings.value("d"), QVariant(QVariantList({QVariantList({1, 2})})));
+        }
+
+        // A store decodes values when they're read, a value too deep still fails the load
+        {
+            const QVariant deep = QVariantList({QVariantList({QVariantList({QVariantList({1})})})});
+            QJsonSettings::setMaxDepth(orgMaxDepth);
+            QJsonSettingsStore store;
+            store.setValue("d", deep);
+            QVERIFY(store.save(settingsPath));
+
+            QJsonSettings::setMaxDepth(3);
+            QVERIFY(!store.load(settingsPath));
+            QCOMPARE(store.value("d"), deep);
+        }
+
+        QJsonSettings::setMaxDepth(orgMaxDepth);
+    }
+
+    void testLimits() {
+        const QByteArray data = R"({"a": {"b": 1, "c": "hello world"}, "d": [1, 2, 3]})";
+        const auto read = [&data](const QJsonSettings::Limits &limits) {
+            QJsonSettings::setLimits(limits);
+            QBuffer buffer;
+            buffer.setData(data);
+            QSettings::SettingsMap result;
+            const bool ok = buffer.open(QIODevice::ReadOnly) && QJsonSettings::read(buffer, result);
+            QJsonSettings::setLimits({});
+            return ok ? QJsonSettings::Error{} : QJsonSettings::lastError();
+        };
+
+        // Within the limits
+        QCOMPARE(read({data.size(), 4, 11, 3}).reason, QJsonSettings::Error::NoError);
+
+        // Each limit stops reading where it's exceeded
+        auto error = read({10, 0, 0, 0});
+        QCOMPARE(error.reason, QJsonSettings::Error::FileTooLarge);
+        QCOMPARE(error.offset, qint64(10));
+
+        error = read({0, 3, 0, 0});
+        QCOMPARE(error.reason, QJsonSettings::Error::TooManyKeys);
+        QCOMPARE(error.offset, qint64(data.indexOf(R"("d":)") + 3));
+
+        error = read({0, 0, 5, 0});
+        QCOMPARE(error.reason, QJsonSettings::Error::StringTooLong);
+        QCOMPARE(error.offset, qint64(data.indexOf("hello") + 5));
+
+        error = read({0, 0, 0, 2});
+        QCOMPARE(error.reason, QJsonSettings::Error::TooManyElements);
+        QCOMPARE(error.offset, qint64(data.lastIndexOf(',')));
+
+        // Syntax errors are reported where the parser stopped
+        QBuffer buffer;
+        buffer.setData(R"({"a": 1,})");
+        QVERIFY(buffer.open(QIODevice::ReadOnly));
+        QSettings::SettingsMap result;
+        QVERIFY(!QJsonSettings::read(buffer, result));
+        QCOMPARE(QJsonSettings::lastError().reason, QJsonSettings::Error::SyntaxError);
+        QVERIFY(QJsonSettings::lastError().offset > 0);
+
+        // The other readers of settings files apply the same limits
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            QCOMPARE(file.write(data), data.size());
+        }
+        QJsonSettings::setLimits({10, 0, 0, 0});
+        QJsonSettingsOverlay overlay;
+        QVERIFY(!overlay.addLayer(settingsPath, false));
+        QCOMPARE(QJsonSettings::lastError().reason, QJsonSettings::Error::FileTooLarge);
+        QJsonSettingsWatcher watcher(settingsPath);
+        QVERIFY(watcher.settings().isEmpty());
+        QCOMPARE(QJsonSettings::lastError().reason, QJsonSettings::Error::FileTooLarge);
+        QJsonSettings::setLimits({});
+        QCOMPARE(watcher.reload().size(), 3);
+    }
+
+    void testWatcher() {
+        // Write settings
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("foo/bar", 1);
+            settings.setValue("foo/baz", 2);
+            settings.setValue("qux/quux", 3);
+            settings.sync();
+        }
+
+        QJsonSettingsWatcher watcher(settingsPath);
+        QCOMPARE(watcher.settings().size(), 3);
+
+        QSignalSpy spy(&watcher, &QJsonSettingsWatcher::changed);
+
+        // Modify one branch in another settings instance
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("foo/baz", 4);
+            settings.setValue("corge", 5);
+            settings.sync();
+        }
+
+        // The file system notification reloads the file
+        QTRY_COMPARE(spy.size(), 1);
+        QCOMPARE(spy.first().first().toStringList(), QStringList({"corge", "foo/baz"}));
+        QCOMPARE(watcher.settings().value("foo/baz").toInt(), 4);
+
+        // Nothing changed since the last reload
+        QVERIFY(watcher.reload().isEmpty());
+        QCOMPARE(spy.size(), 1);
+
+        // A branch that fails to decode keeps its last values
+        const int orgMaxDepth = QJsonSettings::maxDepth();
+        QJsonSettings::setMaxDepth(2);
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+            QVERIFY(file.write(R"({"foo": {"bar": {"a": {"b": 1}}}, "qux": {"quux": 3}, )"
+                               R"("corge": 5})") > 0);
+        }
+        QVERIFY(watcher.reload().isEmpty());
+        QCOMPARE(watcher.settings().value("foo/bar").toInt(), 1);
+        QCOMPARE(watcher.settings().value("foo/baz").toInt(), 4);
+        QJsonSettings::setMaxDepth(orgMaxDepth);
+    }
+
+    void testSchema() {
+        const QList<QPair<QString, QVariant>> testPairs = {
+            {"foo/int", 810},
+            {"foo/longlong", std::numeric_limits<qlonglong>::max() - 1},
+            {"foo/rect", QRect(10, 20, 30, 40)},
+            {"bar", "Hello, world!"},
+            {"bar/doubleList", QVariant::fromValue(QList<double>({1.5, 2.5}))},
+        };
+
+        // Write settings
+        {
+            QSettings settings(settingsPath, format);
+            for (const auto &pair : testPairs) {
+                settings.setValue(pair.first, pair.second);
+            }
+            settings.setValue("unknown", true);
+            settings.sync();
+        }
+
+        QJsonSettingsSchema schema;
+        for (const auto &pair : testPairs) {
+            schema.insert(pair.first, pair.second.userType());
+        }
+
+        // Read with schema
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+
+            QSettings::SettingsMap map;
+            QVERIFY(QJsonSettings::read(file, map, schema));
+            for (const auto &pair : testPairs) {
+                QCOMPARE(map.value(pair.first), pair.second);
+            }
+            QCOMPARE(map.value("unknown"), QVariant(true));
+        }
+
+        // Skip unknown keys
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+
+            schema.setUnknownKeyPolicy(QJsonSettingsSchema::SkipUnknownKeys);
+            QSettings::SettingsMap map;
+            QVERIFY(QJsonSettings::read(file, map, schema));
+            QCOMPARE(map.size(), testPairs.size());
+        }
+
+        // Reject unknown keys
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+
+            schema.setUnknownKeyPolicy(QJsonSettingsSchema::RejectUnknownKeys);
+            QSettings::SettingsMap map;
+            QVERIFY(!QJsonSettings::read(file, map, schema));
+        }
+
+        // Numbers out of the range of their type are read as they're stored
+        {
+            QBuffer buffer;
+            buffer.setData(R"({"uint": -1, "int": 1e10, "float": 1e300})");
+            QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+            QJsonSettingsSchema numbers;
+            numbers.insert("uint", QMetaType::UInt);
+            numbers.insert("int", QMetaType::Int);
+            numbers.insert("float", QMetaType::Float);
+            QSettings::SettingsMap map;
+            QVERIFY(QJsonSettings::read(buffer, map, numbers));
+            QCOMPARE(map.value("uint"), QVariant(-1.0));
+            QCOMPARE(map.value("int"), QVariant(1e10));
+            QCOMPARE(map.value("float"), QVariant(1e300));
+        }
+    }
+
+    void testAsync() {
+        const QSettings::SettingsMap testSettings = {
+            {"foo",     "abc"                },
+            {"foo/bar", 123                  },
+            {"baz",     QRect(10, 20, 30, 40)},
+        };
+
+        // Write settings
+        {
+            auto future = QJsonSettings::writeAsync(settingsPath, testSettings);
+            future.waitForFinished();
+            QVERIFY(future.result());
+        }
+
+        // Read settings
+        {
+            auto future = QJsonSettings::readAsync(settingsPath);
+            future.waitForFinished();
+            QCOMPARE(future.resultCount(), 1);
+
+            const auto &result = future.result();
+            QCOMPARE(result.error.reason, QJsonSettings::Error::NoError);
+            QCOMPARE(result.settings.value("foo"), QVariant("abc"));
+            QCOMPARE(result.settings.value("foo/bar").toInt(), 123);
+            QCOMPARE(result.settings.value("baz"), QVariant(QRect(10, 20, 30, 40)));
+        }
+
+        // Read missing file
+        {
+            auto future = QJsonSettings::readAsync(randomSettingsFileName());
+            future.waitForFinished();
+            QCOMPARE(future.resultCount(), 1);
+            QCOMPARE(future.result().error.reason, QJsonSettings::Error::ReadError);
+        }
+
+        // The error of the read is carried over from the thread it ran on
+        {
+            QJsonSettings::setLimits({10, 0, 0, 0});
+            auto future = QJsonSettings::readAsync(settingsPath);
+            future.waitForFinished();
+            QJsonSettings::setLimits({});
+            QCOMPARE(future.resultCount(), 1);
+            QVERIFY(future.result().settings.isEmpty());
+            QCOMPARE(future.result().error.reason, QJsonSettings::Error::FileTooLarge);
+        }
+    }
+
+    void testWarm() {
+        const auto writeFile = [this](const QByteArray &data) {
+            QFile file(settingsPath);
+            return file.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+                   file.write(data) == data.size();
+        };
+        const auto readFile = [this](QSettings::SettingsMap &settings) {
+            QFile file(settingsPath);
+            return file.open(QIODevice::ReadOnly) && QJsonSettings::read(file, settings);
+        };
+        const auto warm = [this](const QStringList &prefixes) {
+            auto future = QJsonSettings::warm(settingsPath, prefixes);
+            future.waitForFinished();
+            return future.result();
+        };
+
+        QVERIFY(writeFile(R"({
+            "a": {"x": 1, "y": {"z": "abc"}},
+            "b": {"$value": true, "w": 2.5},
+            "c": {"r": {"$ref": "a/x"}},
+            "top": "v"
+        })"));
+        QSettings::SettingsMap expected;
+        QVERIFY(readFile(expected));
+        QCOMPARE(expected.size(), 6);
+
+        // Some groups converted ahead, the read converts the rest
+        QVERIFY(warm({"a", "/b/"}));
+        QSettings::SettingsMap result;
+        QVERIFY(readFile(result));
+        QCOMPARE(result, expected);
+
+        // A group with references is converted by the read
+        QVERIFY(warm({"c"}));
+        result.clear();
+        QVERIFY(readFile(result));
+        QCOMPARE(result, expected);
+
+        // The whole file
+        QVERIFY(warm({}));
+        result.clear();
+        QVERIFY(readFile(result));
+        QCOMPARE(result, expected);
+
+        // A file changed after it was warmed is read again
+        QVERIFY(warm({"a"}));
+        QVERIFY(writeFile(R"({"a": {"x": 2}})"));
+        result.clear();
+        QVERIFY(readFile(result));
+        QCOMPARE(result.size(), 1);
+        QCOMPARE(result.value("a/x").toInt(), 2);
+
+        // So is a file changed without changing its size and modification time
+        QVERIFY(warm({}));
+        const QDateTime modified = QFileInfo(settingsPath).lastModified();
+        QVERIFY(writeFile(R"({"a": {"x": 3}})"));
+        {
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+        result.clear();
+        QVERIFY(readFile(result));
+        QCOMPARE(result.value("a/x").toInt(), 3);
+
+        // Missing file
+        auto future = QJsonSettings::warm(randomSettingsFileName());
+        future.waitForFinished();
+        QVERIFY(!future.result());
+    }
+
+    void testStore() {
+        // Write settings
+        {
+            QSettings settings(settingsPath, format);
+            settings.setValue("foo", "abc");
+            settings.setValue("foo/bar", 123);
+            settings.setValue("foo/baz/qux", QRect(10, 20, 30, 40));
+            settings.setValue("top", true);
+            settings.sync();
+        }
+
+        QJsonSettingsStore store;
+        QVERIFY(store.load(settingsPath));
+        QCOMPARE(store.value("foo"), QVariant("abc"));
+        QCOMPARE(store.value("foo/bar").toInt(), 123);
+        QCOMPARE(store.value("/foo//baz/qux/"), QVariant(QRect(10, 20, 30, 40)));
+        QVERIFY(!store.contains("foo/baz"));
+        QCOMPARE(store.value("missing", 42), QVariant(42));
+
+        QCOMPARE(store.childKeys(), QStringList({"foo", "top"}));
+        QCOMPARE(store.childGroups(), QStringList({"foo"}));
+        QCOMPARE(store.childKeys("foo"), QStringList({"bar"}));
+        QCOMPARE(store.childGroups("foo"), QStringList({"baz"}));
+
+        // Modify
+        store.setValue("foo", "def");
+        store.setValue("top/child", 1);
+        store.remove("foo/baz");
+        QCOMPARE(store.value("foo"), QVariant("def"));
+        QCOMPARE(store.value("top"), QVariant(true));
+        QCOMPARE(store.childGroups(), QStringList({"foo", "top"}));
+        QCOMPARE(store.childGroups("foo"), QStringList());
+
+        // The store agrees with QSettings on the saved file
+        QVERIFY(store.save(settingsPath));
+        {
+            QSettings settings(settingsPath, format);
+            QCOMPARE(settings.allKeys().size(), 4);
+            QCOMPARE(settings.value("foo"), QVariant("def"));
+            QCOMPARE(settings.value("foo/bar").toInt(), 123);
+            QCOMPARE(settings.value("top/child").toInt(), 1);
+        }
+        QCOMPARE(store.toSettingsMap().size(), 4);
+
+        // Values that weren't modified are saved back unchanged
+        {
+            QJsonSettingsStore reloaded;
+            QBuffer buffer;
+            QVERIFY(buffer.open(QIODevice::ReadWrite));
+            QVERIFY(reloaded.load(settingsPath));
+            QCOMPARE(reloaded.value("foo/bar").toInt(), 123);
+            QVERIFY(reloaded.save(buffer));
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QCOMPARE(QJsonDocument::fromJson(buffer.data()),
+                     QJsonDocument::fromJson(file.readAll()));
+        }
+
+        // Wide group, inserted out of order
+        {
+            QStringList keys;
+            for (int i = 0; i < 1000; ++i) {
+                const int n = i * 7919 % 1000;
+                keys.append(QString::number(n).rightJustified(4, '0'));
+                store.setValue("wide/" + keys.last(), n);
+            }
+            store.setValue("wide/0001/sub", true);
+            store.remove("wide/0002");
+            keys.removeOne("0002");
+            keys.sort();
+            QCOMPARE(store.childKeys("wide"), keys);
+            QCOMPARE(store.childGroups("wide"), QStringList({"0001"}));
+            QCOMPARE(store.value("wide/0001/sub"), QVariant(true));
+            QCOMPARE(store.value("wide/0999").toInt(), 999);
+        }
+
+        store.remove("");
+        QVERIFY(store.isEmpty());
+        QVERIFY(!store.load(randomSettingsFileName()));
+    }
+
+    void testStoreSync() {
+        QJsonSettingsStore first;
+        QJsonSettingsStore second;
+
+        // Both stores start from the same file
+        first.setValue("shared", "abc");
+        first.setValue("foo/bar", 1);
+        QVERIFY(first.sync(settingsPath));
+        QVERIFY(second.load(settingsPath));
+
+        // Changes to different keys are merged
+        first.setValue("foo/baz", 2);
+        first.remove("shared");
+        second.setValue("other", true);
+        second.setValue("foo/bar", 3);
+        QVERIFY(first.sync(settingsPath));
+        QVERIFY(second.sync(settingsPath));
+        QCOMPARE(second.value("foo/bar").toInt(), 3);
+        QCOMPARE(second.value("foo/baz").toInt(), 2);
+        QCOMPARE(second.value("other"), QVariant(true));
+        QVERIFY(!second.contains("shared"));
+
+        // The latest sync wins on the keys changed by both
+        first.setValue("foo/bar", 4);
+        QVERIFY(first.sync(settingsPath));
+        QJsonSettingsStore reloaded;
+        QVERIFY(reloaded.load(settingsPath));
+        QCOMPARE(reloaded.toSettingsMap(), QSettings::SettingsMap({
+                                               {"foo/bar", 4   },
+                                               {"foo/baz", 2   },
+                                               {"other",   true},
+        }));
+        QVERIFY(!QFile::exists(settingsPath + ".lock"));
+
+        // A change that keeps the size and modification time is still merged
+        QVERIFY(first.load(settingsPath));
+        {
+            QJsonSettingsStore other;
+            QVERIFY(other.load(settingsPath));
+            other.setValue("foo/bar", 7);
+
+            const QDateTime modified = QFileInfo(settingsPath).lastModified();
+            QVERIFY(other.save(settingsPath));
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+        first.setValue("foo/baz", 5);
+        QVERIFY(first.sync(settingsPath));
+        QCOMPARE(first.value("foo/bar").toInt(), 7);
+        QCOMPARE(first.value("foo/baz").toInt(), 5);
+    }
+
+    void testIncrementalWrites() {
+        // Every version is written the same as by a full write
+        const QList<QSettings::SettingsMap> versions = {
+            {{"a", 1}, {"a/b", "abc"}, {"c/d", QRect(1, 2, 3, 4)}, {"e", true}},
+            {{"a", 2}, {"a/b", "abc"}, {"c/d", QRect(1, 2, 3, 4)}, {"e", true}},
+            {{"a/b", "abc"}, {"c/d", QRect(1, 2, 3, 4)}, {"e", true}},
+            {{"a", "x"}, {"c/d", QRect(1, 2, 3, 4)}, {"e", true}},
+            {{"a", "x"}, {"e", true}, {"e/f", 1.5}},
+            {},
+        };
+
+        QJsonSettings::setIncrementalWrites(true);
+        for (const auto &settings : versions) {
+            QBuffer buffer;
+            QVERIFY(buffer.open(QIODevice::WriteOnly));
+            QVERIFY(QJsonSettings::write(buffer, settings));
+
+            {
+                QFile file(settingsPath);
+                QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+                QVERIFY(QJsonSettings::write(file, settings));
+            }
+            QFile file(settingsPath);
+            QVERIFY(file.open(QIODevice::ReadOnly));
+            QCOMPARE(file.readAll(), buffer.data());
+        }
+        QJsonSettings::setIncrementalWrites(false);
+    }
+
+    void testThrottle() {
+        QJsonSettingsThrottle throttle(settingsPath);
+        QSignalSpy spy(&throttle, &QJsonSettingsThrottle::written);
+
+        // A burst of changes is written once
+        throttle.setValue("a", 1);
+        throttle.setValue("a", 2);
+        throttle.setValue("b/c", true);
+        QCOMPARE(throttle.dirtyKeys(), QStringList({"a", "b/c"}));
+        QTRY_COMPARE(spy.count(), 1);
+        QVERIFY(!throttle.isDirty());
+        {
+            QJsonSettingsStore store;
+            QVERIFY(store.load(settingsPath));
+            QCOMPARE(store.value("a").toInt(), 2);
+            QCOMPARE(store.value("b/c"), QVariant(true));
+        }
+
+        // Changes wait for the interval of their group since the last write it caused
+        throttle.setWriteInterval("ui", 60000);
+        QCOMPARE(throttle.writeInterval("ui/splitter"), 60000);
+        QCOMPARE(throttle.writeInterval("a"), 0);
+        throttle.setValue("ui/splitter", 10);
+        QTRY_COMPARE(spy.count(), 2);
+        throttle.setValue("ui/splitter", 20);
+        QTest::qWait(50);
+        QCOMPARE(spy.count(), 2);
+        QCOMPARE(throttle.dirtyKeys(), QStringList({"ui/splitter"}));
+
+        // Pending changes are written on demand
+        QVERIFY(throttle.flush());
+        QVERIFY(!throttle.isDirty());
+        {
+            QJsonSettingsStore store;
+            QVERIFY(store.load(settingsPath));
+            QCOMPARE(store.value("ui/splitter").toInt(), 20);
+        }
+
+        // A failed write is retried
+        QVERIFY(QFile::remove(settingsPath));
+        QVERIFY(QDir().mkdir(settingsPath));
+        throttle.setValue("a", 3);
+        QTRY_COMPARE(spy.count(), 4);
+        QCOMPARE(spy.last().at(0), QVariant(false));
+        QVERIFY(throttle.isDirty());
+        QVERIFY(QDir().rmdir(settingsPath));
+        QTRY_COMPARE(spy.count(), 5);
+        QCOMPARE(spy.last().at(0), QVariant(true));
+        QVERIFY(!throttle.isDirty());
+    }
+
+    void testOverlay() {
+        const QList<QSettings::SettingsMap> testLayers = {
+            {{"a", 1}, {"g/x", 1}, {"g/y", 2}, {"h", "leaf"}},
+            {{"g/y", 3}, {"h/sub", 4}},
+            {{"a", "user"}, {"g/z", QRect(10, 20, 30, 40)}, {"g", "group"}},
+        };
+
+        QStringList paths;
+        for (const auto &layer : testLayers) {
+            paths.append(randomSettingsFileName());
+            QSettings settings(paths.last(), format);
+            for (auto it = layer.begin(); it != layer.end(); ++it) {
+                settings.setValue(it.key(), it.value());
+            }
+            settings.sync();
+        }
+
+        QJsonSettingsOverlay overlay;
+        for (const auto &path : std::as_const(paths)) {
+            QVERIFY(overlay.addLayer(path));
+        }
+        QVERIFY(overlay.addLayer(randomSettingsFileName()));
+        QCOMPARE(overlay.layers().size(), 4);
+
+        QCOMPARE(overlay.value("a"), QVariant("user"));
+        QCOMPARE(overlay.value("g/x").toInt(), 1);
+        QCOMPARE(overlay.value("g/y").toInt(), 3);
+        QCOMPARE(overlay.value("g/z"), QVariant(QRect(10, 20, 30, 40)));
+        QCOMPARE(overlay.value("g"), QVariant("group"));
+        QCOMPARE(overlay.value("h"), QVariant("leaf"));
+        QCOMPARE(overlay.value("h/sub").toInt(), 4);
+        QVERIFY(!overlay.contains("missing"));
+
+        QCOMPARE(overlay.childKeys(), QStringList({"a", "g", "h"}));
+        QCOMPARE(overlay.childGroups(), QStringList({"g", "h"}));
+        QCOMPARE(overlay.childKeys("g"), QStringList({"x", "y", "z"}));
+        QCOMPARE(overlay.toSettingsMap().size(), 7);
+
+        // A shared layer is read again once its file changes
+        {
+            QSettings settings(paths.first(), format);
+            settings.setValue("a", 2);
+            settings.setValue("b", 5);
+            settings.sync();
+        }
+        QJsonSettingsOverlay base;
+        QVERIFY(base.addLayer(paths.first()));
+        QCOMPARE(base.value("b").toInt(), 5);
+
+        // Even if its size and modification time stay the same
+        const QDateTime modified = QFileInfo(paths.first()).lastModified();
+        {
+            QSettings settings(paths.first(), format);
+            settings.setValue("b", 6);
+            settings.sync();
+        }
+        {
+            QFile file(paths.first());
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+        QJsonSettingsOverlay rewritten;
+        QVERIFY(rewritten.addLayer(paths.first()));
+        QCOMPARE(rewritten.value("b").toInt(), 6);
+        QJsonSettingsOverlay::clearSharedLayers();
+
+        for (const auto &path : std::as_const(paths)) {
+            std::ignore = QFile::remove(path);
+        }
+    }
+
+    void testJsonLines() {
+        const QSettings::SettingsMap testSettings = {
+            {"foo",         "abc"                  },
+            {"foo/bar",     123                    },
+            {"foo/baz/qux", QRect(10, 20, 30, 40)  },
+            {"list",        QStringList({"a", "b"})},
+        };
+
+        // Settings map
+        {
+            QBuffer buffer;
+            QVERIFY(buffer.open(QIODevice::ReadWrite));
+            QVERIFY(QJsonSettings::exportJsonLines(buffer, testSettings));
+            QCOMPARE(buffer.data().count('\n'), testSettings.size());
+
+            buffer.seek(0);
+            QSettings::SettingsMap settings;
+            QVERIFY(QJsonSettings::importJsonLines(buffer, settings));
+            QCOMPARE(settings.keys(), testSettings.keys());
+            QCOMPARE(settings.value("foo/baz/qux"), testSettings.value("foo/baz/qux"));
+            QCOMPARE(settings.value("list"), testSettings.value("list"));
+        }
+
+        // Settings file
+        {
+            QBuffer json;
+            QVERIFY(json.open(QIODevice::ReadWrite));
+            QVERIFY(QJsonSettings::write(json, testSettings));
+
+            json.seek(0);
+            QBuffer lines;
+            QVERIFY(lines.open(QIODevice::ReadWrite));
+            QVERIFY(QJsonSettings::exportJsonLines(lines, json));
+
+            lines.seek(0);
+            QBuffer output;
+            QVERIFY(output.open(QIODevice::ReadWrite));
+            QVERIFY(QJsonSettings::importJsonLines(lines, output));
+            QCOMPARE(output.data(), json.data());
+        }
+
+        // Invalid record
+        {
+            QBuffer buffer;
+            buffer.setData("{\"key\":\"foo\",\"value\":1}\n{\"value\":2}\n");
+            QVERIFY(buffer.open(QIODevice::ReadOnly));
+            QSettings::SettingsMap settings;
+            QVERIFY(!QJsonSettings::importJsonLines(buffer, settings));
+        }
+    }
 };
 
 QTEST_MAIN(Test)